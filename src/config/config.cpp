@@ -30,8 +30,14 @@
 
 #include "config.h"
 #include "live/livequeue.h"
+#include "live/livesessions.h"
+#include "live/livestreamer.h"
+#include "live/timeshiftmanager.h"
+#include "live/timeshiftpool.h"
+#include "live/timeshiftwriter.h"
+#include "live/writebackscheduler.h"
 
-RoboTVServerConfig::RoboTVServerConfig() : listenPort(LISTEN_PORT) {
+RoboTVServerConfig::RoboTVServerConfig() : listenPort(LISTEN_PORT), workerThreads(WORKER_THREADS) {
 }
 
 void RoboTVServerConfig::Load() {
@@ -46,8 +52,6 @@ void RoboTVServerConfig::Load() {
             esyslog("Unknown config parameter %s = %s in %s", l->Name(), l->Value(), GENERAL_CONFIG_FILE);
         }
     }
-
-    LiveQueue::removeTimeShiftFiles();
 }
 
 bool RoboTVServerConfig::Parse(const char* Name, const char* Value) {
@@ -57,6 +61,42 @@ bool RoboTVServerConfig::Parse(const char* Name, const char* Value) {
     else if(!strcasecmp(Name, "MaxTimeShiftSize")) {
         LiveQueue::setBufferSize(strtoull(Value, NULL, 10));
     }
+    else if(!strcasecmp(Name, "TimeShiftBackend")) {
+        LiveQueue::setStorageBackend(Value);
+    }
+    else if(!strcasecmp(Name, "TimeShiftBudget")) {
+        TimeShiftManager::instance().setBudget(strtoull(Value, NULL, 10));
+    }
+    else if(!strcasecmp(Name, "TimeShiftReserve")) {
+        TimeShiftManager::instance().setReserve(strtoull(Value, NULL, 10));
+    }
+    else if(!strcasecmp(Name, "TimeShiftPoolSize")) {
+        TimeShiftPool::instance().setSize(atoi(Value));
+    }
+    else if(!strcasecmp(Name, "TimeShiftWriterThreads")) {
+        TimeShiftWriter::instance().setThreads(atoi(Value));
+    }
+    else if(!strcasecmp(Name, "TimeShiftWriteBackInterval")) {
+        WriteBackScheduler::instance().setInterval(atoi(Value));
+    }
+    else if(!strcasecmp(Name, "TimeShiftSegmentSize")) {
+        LiveQueue::setSegmentSize(strtoull(Value, NULL, 10));
+    }
+    else if(!strcasecmp(Name, "TimeShiftMaxDuration")) {
+        LiveQueue::setMaxDuration(atoi(Value));
+    }
+    else if(!strcasecmp(Name, "TimeShiftRamSize")) {
+        LiveQueue::setRamSize(strtoull(Value, NULL, 10));
+    }
+    else if(!strcasecmp(Name, "TimeShiftHugePages")) {
+        LiveQueue::setHugePages(!strcasecmp(Value, "true"));
+    }
+    else if(!strcasecmp(Name, "LiveSessionGracePeriod")) {
+        LiveSessions::instance().setGracePeriod(atoi(Value));
+    }
+    else if(!strcasecmp(Name, "MaxLiveLag")) {
+        LiveStreamer::setMaxLiveLag(atoi(Value));
+    }
     else if(!strcasecmp(Name, "PiconsURL")) {
         piconsUrl = Value;
     }
@@ -67,6 +107,13 @@ bool RoboTVServerConfig::Parse(const char* Name, const char* Value) {
         isyslog("EPG images template URL: %s", Value);
         epgImageUrl = Value;
     }
+    else if(!strcasecmp(Name, "WorkerThreads")) {
+        workerThreads = atoi(Value);
+
+        if(workerThreads < 1) {
+            workerThreads = WORKER_THREADS;
+        }
+    }
     else if(!strcasecmp(Name, "SeriesFolder")) {
         isyslog("Folder for TV shows: %s", Value);
         seriesFolder = Value;
@@ -37,6 +37,12 @@
 #define STORAGE_DB_FILE     "storage.db"
 
 #define LISTEN_PORT       34892
+#define WORKER_THREADS    4
+#define MAX_PENDING_REQUESTS 64
+#define MAX_SEND_IOV      64
+#define MIN_COMPRESS_SIZE 512
+#define PUSH_MAX_DELAY    100
+#define REQUEST_TIMEOUT   500
 
 // backward compatibility
 
@@ -62,6 +68,7 @@ public:
     std::string configDirectory; // config directory path
     std::string cacheDirectory; // cache directory path
     uint16_t listenPort; // Port of remote server
+    int workerThreads; // number of threads processing client requests
     std::string piconsUrl;
     std::string reorderCmd;
     std::string epgImageUrl;
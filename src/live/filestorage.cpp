@@ -0,0 +1,162 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <cstring>
+#include <vdr/tools.h>
+
+#include "filestorage.h"
+
+FileStorage::FileStorage() : m_readFd(-1), m_writeFd(-1) {
+}
+
+FileStorage::~FileStorage() {
+    close();
+}
+
+bool FileStorage::open(const std::string& filename, off_t size) {
+    m_writeFd = ::open(filename.c_str(), O_CREAT | O_WRONLY, 0644);
+    int rc = preallocate(m_writeFd, size);
+
+    if(rc != 0) {
+        dsyslog("unable to pre-allocate %li bytes for timeshift ringbuffer", size);
+        dsyslog("ERROR: %s (status = %i)", strerror(rc), rc);
+    }
+
+    m_readFd = ::open(filename.c_str(), O_NOATIME | O_RDONLY, 0644);
+
+    if(m_readFd == -1) {
+        return false;
+    }
+
+    lseek(m_writeFd, 0, SEEK_SET);
+
+    return true;
+}
+
+void FileStorage::close() {
+    if(m_readFd != -1) {
+        ::close(m_readFd);
+    }
+
+    if(m_writeFd != -1) {
+        ::close(m_writeFd);
+    }
+
+    m_readFd = -1;
+    m_writeFd = -1;
+}
+
+off_t FileStorage::writePosition() {
+    return lseek(m_writeFd, 0, SEEK_CUR);
+}
+
+void FileStorage::wrap() {
+    int rc = ftruncate(m_writeFd, writePosition());
+
+    if(rc == -1) {
+        esyslog("truncating the timeshift buffer failed: %i - %s", errno, strerror(errno));
+    }
+
+    lseek(m_writeFd, 0, SEEK_SET);
+}
+
+bool FileStorage::write(struct iovec* iov, int iovcnt) {
+    struct iovec* v = iov;
+
+    while(iovcnt > 0) {
+        ssize_t rc = ::writev(m_writeFd, v, iovcnt);
+
+        if(rc == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if(rc <= 0) {
+            return false;
+        }
+
+        // skip completely written buffers
+        while(iovcnt > 0 && (size_t)rc >= v->iov_len) {
+            rc -= v->iov_len;
+            v++;
+            iovcnt--;
+        }
+
+        if(iovcnt > 0) {
+            v->iov_base = (uint8_t*)v->iov_base + rc;
+            v->iov_len -= rc;
+        }
+    }
+
+    return true;
+}
+
+size_t FileStorage::readData(off_t position, uint8_t* buffer, size_t length) {
+    size_t done = 0;
+
+    while(done < length) {
+        ssize_t rc = pread(m_readFd, buffer + done, length - done, position + done);
+
+        if(rc == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if(rc <= 0) {
+            break;
+        }
+
+        done += rc;
+    }
+
+    return done;
+}
+
+bool FileStorage::writeAt(off_t position, const uint8_t* data, size_t length) {
+    while(length > 0) {
+        ssize_t rc = pwrite(m_writeFd, data, length, position);
+
+        if(rc == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if(rc <= 0) {
+            return false;
+        }
+
+        data += rc;
+        length -= rc;
+        position += rc;
+    }
+
+    return true;
+}
+
+void FileStorage::writeBack(off_t start, off_t end) {
+    if(!syncRange(m_writeFd, start, end)) {
+        esyslog("Failed to sync timeshift ring-buffer !");
+    }
+}
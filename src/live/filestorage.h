@@ -0,0 +1,75 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_FILESTORAGE_H
+#define ROBOTV_FILESTORAGE_H
+
+#include "timeshiftstorage.h"
+
+/**
+ * Timeshift storage on top of a regular file.
+ * Reads and writes go through separate file descriptors, the file
+ * offset of the write descriptor is used as write cursor.
+ */
+class FileStorage : public TimeShiftStorage {
+public:
+
+    FileStorage();
+
+    virtual ~FileStorage();
+
+    bool open(const std::string& filename, off_t size);
+
+    void close();
+
+    off_t writePosition();
+
+    void wrap();
+
+    bool write(struct iovec* iov, int iovcnt);
+
+    size_t readData(off_t position, uint8_t* buffer, size_t length);
+
+    bool writeAt(off_t position, const uint8_t* data, size_t length);
+
+    void writeBack(off_t start, off_t end);
+
+    int fileDescriptor() {
+        return m_readFd;
+    }
+
+    const char* name() const {
+        return "file";
+    }
+
+private:
+
+    int m_readFd;
+
+    int m_writeFd;
+
+};
+
+#endif // ROBOTV_FILESTORAGE_H
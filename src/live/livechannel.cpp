@@ -0,0 +1,467 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <algorithm>
+#include <vdr/remux.h>
+
+#include "config/config.h"
+#include "net/msgpacket.h"
+#include "robotv/robotvcommand.h"
+#include "tools/hash.h"
+#include "tools/time.h"
+
+#include "livechannel.h"
+#include "livestreamer.h"
+#include "channelcache.h"
+
+std::map<LiveChannel::Key, LiveChannel::Entry> LiveChannel::m_channels;
+std::mutex LiveChannel::m_channelsMutex;
+std::condition_variable LiveChannel::m_channelsCond;
+int LiveChannel::m_nextId = 0;
+
+std::shared_ptr<LiveChannel> LiveChannel::open(const cChannel* channel, int priority, const std::string& language, StreamInfo::Type streamType, int& status) {
+    if(channel == nullptr) {
+        esyslog("unknown channel !");
+        status = ROBOTV_RET_ERROR;
+        return nullptr;
+    }
+
+    Key key(roboTV::Hash::createChannelUid(channel), language, (int)streamType);
+    std::shared_ptr<LiveChannel> result;
+
+    {
+        std::unique_lock<std::mutex> lock(m_channelsMutex);
+
+        // remove streams without viewers
+        for(auto i = m_channels.begin(); i != m_channels.end();) {
+            if(!i->second.opening && i->second.channel.expired()) {
+                i = m_channels.erase(i);
+            }
+            else {
+                i++;
+            }
+        }
+
+        // wait for another viewer tuning the same stream
+        auto i = m_channels.find(key);
+
+        while(i != m_channels.end() && i->second.opening) {
+            m_channelsCond.wait(lock);
+            i = m_channels.find(key);
+        }
+
+        // join running stream
+        if(i != m_channels.end()) {
+            result = i->second.channel.lock();
+
+            if(result) {
+                isyslog("joining live stream of channel %s", channel->Name());
+                status = ROBOTV_RET_OK;
+                return result;
+            }
+        }
+
+        m_channels[key] = { std::weak_ptr<LiveChannel>(), true };
+        result.reset(new LiveChannel(priority, language, streamType));
+    }
+
+    // tuning may take a while, don't hold up other channels
+    status = result->switchChannel(channel);
+
+    if(status != ROBOTV_RET_OK) {
+        result.reset();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_channelsMutex);
+
+        if(result) {
+            m_channels[key] = { result, false };
+        }
+        else {
+            m_channels.erase(key);
+        }
+    }
+
+    m_channelsCond.notify_all();
+    return result;
+}
+
+LiveChannel::LiveChannel(int priority, const std::string& language, StreamInfo::Type streamType)
+    : cReceiver(nullptr, priority)
+    , m_language(language)
+    , m_langStreamType(streamType)
+    , m_uid(0) {
+    // create timeshift queue
+    m_queue = new LiveQueue(m_nextId++);
+
+    // wakeup viewers in push mode
+    m_queue->setWriteCallback([this]() {
+        notifyViewers();
+    });
+}
+
+LiveChannel::~LiveChannel() {
+    cDevice * device = Device();
+
+    if(device != nullptr) {
+        cCamSlot *camSlot = device->CamSlot();
+
+        if (camSlot != nullptr) {
+            isyslog("camslot detached");
+            ChannelCamRelations.ClrChecked(ChannelID(), camSlot->SlotNumber());
+        }
+
+        Detach();
+    }
+
+    reset();
+    delete m_queue;
+    delete m_streamChange;
+
+    isyslog("live channel terminated");
+}
+
+void LiveChannel::addViewer(LiveStreamer* viewer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_viewers.push_back(viewer);
+    m_queue->setViewers(m_viewers.size());
+    updatePriority();
+}
+
+void LiveChannel::removeViewer(LiveStreamer* viewer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_viewers.remove(viewer);
+    m_queue->setViewers(m_viewers.size());
+    updatePriority();
+}
+
+void LiveChannel::updatePriority() {
+    // a channel without viewers keeps its priority (lost sessions)
+    if(m_viewers.empty()) {
+        return;
+    }
+
+    // the receiver runs with the highest priority of its viewers
+    int priority = MINPRIORITY;
+
+    for(auto viewer : m_viewers) {
+        priority = std::max(priority, viewer->m_priority);
+    }
+
+    if(priority != Priority()) {
+        isyslog("live channel priority: %i", priority);
+        SetPriority(priority);
+    }
+}
+
+void LiveChannel::notifyViewers() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for(auto viewer : m_viewers) {
+        viewer->requestPush();
+    }
+}
+
+MsgPacket* LiveChannel::getStreamChange() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (m_streamChange != nullptr) ? m_streamChange->clone() : nullptr;
+}
+
+int LiveChannel::switchChannel(const cChannel* channel) {
+    if(channel == nullptr) {
+        esyslog("unknown channel !");
+        return ROBOTV_RET_ERROR;
+    }
+
+    // get device for this channel
+    cDevice* device = cDevice::GetDevice(channel, LIVEPRIORITY, false);
+
+    // maybe an encrypted channel that cannot be handled
+    // lets try if a device can decrypt it on it's own (without a CAM slot)
+    if(device == nullptr) {
+        device = cDevice::GetDeviceForTransponder(channel, LIVEPRIORITY);
+    }
+
+    // maybe all devices busy
+    if(device == nullptr) {
+        esyslog("No device available !");
+        return ROBOTV_RET_DATALOCKED;
+    }
+
+    isyslog("Found available device %d", device->DeviceNumber() + 1);
+
+    if(!device->SwitchChannel(channel, false)) {
+        esyslog("Can't switch to channel %i - %s", channel->Number(), channel->Name());
+        return ROBOTV_RET_ERROR;
+    }
+
+    m_uid = roboTV::Hash::createChannelUid(channel);
+
+    StreamBundle currentItem = createFromChannel(channel);
+    m_channelBundle = currentItem;
+
+    // get cached demuxer data
+    ChannelCache &cache = ChannelCache::instance();
+    StreamBundle cacheItem = cache.lookup(m_uid);
+
+    // channel already in cache
+    if (!cacheItem.empty()) {
+        isyslog("Channel information found in cache");
+    }
+    // channel not found in cache -> add it from vdr
+    else {
+        isyslog("adding channel to cache");
+        cacheItem = currentItem;
+        cache.add(m_uid, cacheItem);
+    }
+
+    // recheck cache item
+    if (!currentItem.isMetaOf(cacheItem)) {
+        isyslog("current channel differs from cache item - updating");
+        cacheItem = currentItem;
+        cache.add(m_uid, cacheItem);
+    }
+
+    if(cacheItem.empty()) {
+        esyslog("channel %i - %s doesn't have any stream information", channel->Number(), channel->Name());
+        return false;
+    }
+
+    isyslog("Creating demuxers");
+    createDemuxers(&cacheItem);
+
+    onStreamChange();
+
+    isyslog("Successfully switched to channel %i - %s", channel->Number(), channel->Name());
+
+    // fool device to not start the decryption timer
+    int priority = Priority();
+    SetPriority(MINPRIORITY);
+
+    /// attach receiver
+    if (device->AttachReceiver(this) == false) {
+        esyslog("failed to attach receiver !");
+        return false;
+    }
+
+    // start decrypting manually
+    cCamSlot* slot = device->CamSlot();
+
+    if(slot) {
+        slot->StartDecrypting();
+    }
+
+    SetPriority(priority);
+
+    isyslog("done switching.");
+    return ROBOTV_RET_OK;
+}
+
+MsgPacket *LiveChannel::createStreamChangePacket(DemuxerBundle &bundle) {
+    StreamBundle cache;
+
+    for(auto i = bundle.begin(); i != bundle.end(); i++) {
+        cache.addStream(*(*i));
+    }
+
+    ChannelCache::instance().add(m_uid, cache);
+
+    // reorder streams as preferred
+    bundle.reorderStreams(m_language.c_str(), m_langStreamType);
+
+    return StreamPacketProcessor::createStreamChangePacket(bundle);
+}
+
+MsgPacket* LiveChannel::createSignalInfo() {
+    cDevice* device = Device();
+
+    if(device == nullptr || !IsAttached()) {
+        return nullptr;
+    }
+
+    MsgPacket* resp = new MsgPacket(ROBOTV_STREAM_SIGNALINFO, ROBOTV_CHANNEL_STREAM);
+
+    int DeviceNumber = device->DeviceNumber() + 1;
+    int Strength = 0;
+    int Quality = 0;
+
+    Strength = device->SignalStrength();
+    Quality = device->SignalQuality();
+
+    resp->put_String(*cString::sprintf(
+                         "%s #%d - %s",
+                         (const char*)device->DeviceType(),
+                         DeviceNumber,
+                         (const char*)device->DeviceName()));
+
+    // Quality:
+    // 4 - NO LOCK
+    // 3 - NO SYNC
+    // 2 - NO VITERBI
+    // 1 - NO CARRIER
+    // 0 - NO SIGNAL
+
+    if(Quality == -1) {
+        resp->put_String("UNKNOWN (Incompatible device)");
+        Quality = 0;
+    }
+    else {
+        resp->put_String(*cString::sprintf("%s:%s:%s:%s:%s",
+                                           (Quality > 4) ? "LOCKED" : "-",
+                                           (Quality > 0) ? "SIGNAL" : "-",
+                                           (Quality > 1) ? "CARRIER" : "-",
+                                           (Quality > 2) ? "VITERBI" : "-",
+                                           (Quality > 3) ? "SYNC" : "-"));
+    }
+
+    resp->put_U32((Strength << 16) / 100);
+    resp->put_U32((Quality << 16) / 100);
+    resp->put_U32(0);
+    resp->put_U32(0);
+
+    // get provider & service information
+    LOCK_CHANNELS_READ;
+    const cChannel* channel = roboTV::Hash::findChannelByUid(Channels, m_uid);
+
+    if(channel != nullptr) {
+        // put in provider name
+        resp->put_String(channel->Provider());
+
+        // what the heck should be the service name ?
+        // using PortalName for now
+        resp->put_String(channel->PortalName());
+    }
+    else {
+        resp->put_String("");
+        resp->put_String("");
+    }
+
+    dsyslog("RequestSignalInfo");
+    return resp;
+}
+
+void LiveChannel::Receive(const uchar* packet, int length) {
+    putTsPacket((uint8_t*)packet, roboTV::currentTimeMillis().count());
+}
+
+void LiveChannel::processChannelChange(const cChannel* channel) {
+    if(roboTV::Hash::createChannelUid(channel) != m_uid) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_switchMutex);
+
+    // every viewer forwards the change - process it only once
+    if(createFromChannel(channel) == m_channelBundle) {
+        return;
+    }
+
+    isyslog("ChannelChange()");
+
+    Detach();
+    cleanupQueue(); // remove pre-queued packets
+    switchChannel(channel);
+}
+
+void LiveChannel::createDemuxers(StreamBundle* bundle) {
+    DemuxerBundle& demuxers = getDemuxers();
+
+    // update demuxers
+    demuxers.updateFrom(bundle);
+
+    // update pids
+    SetPids(nullptr);
+
+    for(auto i = demuxers.begin(); i != demuxers.end(); i++) {
+        TsDemuxer* dmx = *i;
+        AddPid(dmx->getPid());
+    }
+}
+
+StreamBundle LiveChannel::createFromChannel(const cChannel* channel) {
+    StreamBundle item;
+
+    // add video stream
+    int vpid = channel->Vpid();
+    int vtype = channel->Vtype();
+
+    item.addStream(StreamInfo(vpid,
+                              vtype == 0x02 ? StreamInfo::Type::MPEG2VIDEO :
+                              vtype == 0x1b ? StreamInfo::Type::H264 :
+                              vtype == 0x24 ? StreamInfo::Type::H265 :
+                              StreamInfo::Type::NONE));
+
+    // add (E)AC3 streams
+    for(int i = 0; channel->Dpid(i) != 0; i++) {
+        int dtype = channel->Dtype(i);
+        item.addStream(StreamInfo(channel->Dpid(i),
+                                  dtype == 0x6A ? StreamInfo::Type::AC3 :
+                                  dtype == 0x7A ? StreamInfo::Type::EAC3 :
+                                  StreamInfo::Type::NONE,
+                                  channel->Dlang(i)));
+    }
+
+    // add audio streams
+    for(int i = 0; channel->Apid(i) != 0; i++) {
+        int atype = channel->Atype(i);
+        item.addStream(StreamInfo(channel->Apid(i),
+                                  atype == 0x04 ? StreamInfo::Type::MPEG2AUDIO :
+                                  atype == 0x03 ? StreamInfo::Type::MPEG2AUDIO :
+                                  atype == 0x0f ? StreamInfo::Type::AAC :
+                                  atype == 0x11 ? StreamInfo::Type::LATM :
+                                  StreamInfo::Type::NONE,
+                                  channel->Alang(i)));
+    }
+
+    // add subtitle streams
+    for(int i = 0; channel->Spid(i) != 0; i++) {
+        StreamInfo stream(channel->Spid(i), StreamInfo::Type::DVBSUB, channel->Slang(i));
+
+        stream.setSubtitlingDescriptor(
+                channel->SubtitlingType(i),
+                channel->CompositionPageId(i),
+                channel->AncillaryPageId(i));
+
+        item.addStream(stream);
+    }
+
+    return item;
+}
+
+int64_t LiveChannel::getCurrentTime(TsDemuxer::StreamPacket *p) {
+    return p->streamPosition;
+}
+
+void LiveChannel::onPacket(MsgPacket *p, StreamInfo::Content content, int64_t pts) {
+    // keep the stream information for joining viewers
+    if(content == StreamInfo::Content::STREAMINFO) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        delete m_streamChange;
+        m_streamChange = p->clone();
+    }
+
+    m_queue->queue(p, content, pts);
+}
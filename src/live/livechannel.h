@@ -0,0 +1,154 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_LIVECHANNEL_H
+#define ROBOTV_LIVECHANNEL_H
+
+#include <stdint.h>
+#include <vdr/channels.h>
+#include <vdr/device.h>
+#include <vdr/receiver.h>
+
+#include "robotvdmx/streambundle.h"
+#include "robotvdmx/demuxerbundle.h"
+#include "livequeue.h"
+
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <robotv/StreamPacketProcessor.h>
+
+class LiveStreamer;
+
+/**
+ * Live stream of a channel shared by all viewers.
+ * The channel receives and demuxes the transport stream once and writes
+ * it into a single timeshift queue. Viewers read the queue with their
+ * own cursor. The channel is torn down when the last viewer releases it.
+ */
+class LiveChannel : public cReceiver, protected StreamPacketProcessor {
+public:
+
+    /**
+     * Get the live stream of a channel.
+     * An existing stream with the same channel and audio preferences is
+     * shared, otherwise a new stream is started.
+     * @param channel channel to stream
+     * @param priority receiver priority
+     * @param language preferred audio language
+     * @param streamType preferred audio stream type
+     * @param status receives the ROBOTV_RET_* status code
+     * @return shared live stream or nullptr on failure
+     */
+    static std::shared_ptr<LiveChannel> open(const cChannel* channel, int priority, const std::string& language, StreamInfo::Type streamType, int& status);
+
+    virtual ~LiveChannel();
+
+    LiveQueue* queue() {
+        return m_queue;
+    }
+
+    void addViewer(LiveStreamer* viewer);
+
+    void removeViewer(LiveStreamer* viewer);
+
+    void processChannelChange(const cChannel* channel);
+
+    /**
+     * Get the current stream information.
+     * @return copy of the last stream change packet or nullptr
+     */
+    MsgPacket* getStreamChange();
+
+    MsgPacket* createSignalInfo();
+
+protected:
+
+#if VDRVERSNUM < 20300
+    void Receive(uchar* data, int length);
+#else
+    void Receive(const uchar* Data, int Length);
+#endif
+
+    int64_t getCurrentTime(TsDemuxer::StreamPacket *p);
+
+    void onPacket(MsgPacket* p, StreamInfo::Content content, int64_t pts);
+
+    MsgPacket* createStreamChangePacket(DemuxerBundle& bundle);
+
+private:
+
+    typedef std::tuple<uint32_t, std::string, int> Key;
+
+    struct Entry {
+        std::weak_ptr<LiveChannel> channel;
+        // the channel is being tuned
+        bool opening;
+    };
+
+    LiveChannel(int priority, const std::string& language, StreamInfo::Type streamType);
+
+    int switchChannel(const cChannel* channel);
+
+    StreamBundle createFromChannel(const cChannel* channel);
+
+    void createDemuxers(StreamBundle* bundle);
+
+    void notifyViewers();
+
+    void updatePriority();
+
+    LiveQueue* m_queue = NULL;
+
+    std::string m_language;
+
+    StreamInfo::Type m_langStreamType;
+
+    uint32_t m_uid;
+
+    StreamBundle m_channelBundle;
+
+    MsgPacket* m_streamChange = NULL;
+
+    std::list<LiveStreamer*> m_viewers;
+
+    std::mutex m_mutex;
+
+    std::mutex m_switchMutex;
+
+    static std::map<Key, Entry> m_channels;
+
+    static std::mutex m_channelsMutex;
+
+    static std::condition_variable m_channelsCond;
+
+    static int m_nextId;
+
+};
+
+#endif // ROBOTV_LIVECHANNEL_H
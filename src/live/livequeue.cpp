@@ -23,297 +23,667 @@
  */
 
 #include <sys/types.h>
-#include <dirent.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/uio.h>
+
 #include <cstring>
+#include <algorithm>
+#include <limits>
 
 #include "config/config.h"
 #include "net/msgpacket.h"
 #include "livequeue.h"
+#include "tieredstorage.h"
+#include "segmentedstorage.h"
+#include "timeshiftmanager.h"
+#include "timeshiftpool.h"
+#include "timeshiftwriter.h"
+#include "writebackscheduler.h"
+#include "tools/statistics.h"
 #include "tools/time.h"
 
+#define WRITER_QUEUE_SIZE 512
+#define WRITER_BATCH_SIZE 64
+
+// sync point interval for streams without video
+#define AUDIO_SYNC_INTERVAL 1000
+
+// interval of buffer size updates
+#define SIZE_UPDATE_INTERVAL 10000
+
 std::string LiveQueue::m_timeShiftDir;
+std::string LiveQueue::m_storageBackend = "file";
+uint64_t LiveQueue::m_ramSize = 0;
+bool LiveQueue::m_hugePages = false;
+uint64_t LiveQueue::m_segmentSize = 64 * 1024 * 1024;
+std::chrono::milliseconds LiveQueue::m_maxDuration(0);
 uint64_t LiveQueue::m_bufferSize = 1024 * 1024 * 1024;
 
-LiveQueue::LiveQueue(int socket) : m_readFd(-1), m_writeFd(-1), m_socket(socket) {
-    m_wrapped = false;
-    m_hasWrapped = false;
-    m_writerRunning = true;
+LiveQueue::LiveQueue(int id) : m_id(id), m_writerQueue(WRITER_QUEUE_SIZE) {
+    // the RAM tier needs a single ringbuffer
+    if(m_segmentSize > 0 && m_ramSize == 0) {
+        m_storage = new SegmentedStorage(m_storageBackend, m_segmentSize);
+    }
+    else {
+        m_storage = TimeShiftStorage::create(m_storageBackend);
+    }
+
+    if(m_ramSize > 0) {
+        m_storage = new TieredStorage(m_storage, m_ramSize, m_hugePages);
+    }
+
+    m_scheduled = false;
+    m_storageCreated = false;
+    m_skipToKeyFrame = false;
+    m_hasVideo = false;
+    m_indexChanged = false;
+    m_indexSnapshot = std::make_shared<const TimeShiftIndex>();
+    m_state.store({ -1, -1, 0, 0, 0 });
     m_wrapCount = 0;
-    m_queueStartTime = roboTV::currentTimeMillis();
-    m_lastSyncTime = roboTV::currentTimeMillis();
-    m_writeThread = nullptr;
-    m_pause = false;
+    m_wrapPosition = 0;
+    m_size = m_bufferSize;
+    m_capacity = m_bufferSize;
+    m_queueStartTime = roboTV::currentTimeMillis().count();
+    m_lastSizeUpdate = roboTV::currentTimeMillis();
 
     if(m_timeShiftDir.empty()) {
         m_timeShiftDir = "/video";
     }
+
+    TimeShiftWriter::instance().attach(m_id, this);
 }
 
 LiveQueue::~LiveQueue() {
-    m_writerRunning = false;
+    TimeShiftWriter::instance().detach(m_id);
+    WriteBackScheduler::instance().detach(m_id);
     close();
+    TimeShiftManager::instance().detach(m_id);
 
-    if(m_writeThread != nullptr) {
-        m_writeThread->join();
-    }
+    PacketData p;
 
-    while(!m_writerQueue.empty()) {
-        const PacketData& p = m_writerQueue.front();
+    while(m_writerQueue.pop(p)) {
         delete p.p;
-        m_writerQueue.pop_front();
     }
 
-    delete m_writeThread;
+    delete m_storage;
     isyslog("LiveQueue terminated");
 }
 
-void LiveQueue::start() {
-    if(m_writeThread != nullptr) {
+bool LiveQueue::writeBatch() {
+    static auto& queueWait = roboTV::Statistics::instance().counter("live.writer.queueWaitUs");
+    static auto& queuePackets = roboTV::Statistics::instance().counter("live.writer.packets");
+    static auto& writeCalls = roboTV::Statistics::instance().counter("live.writer.syscalls");
+
+    if(!m_storageCreated) {
+        createRingBuffer();
+        m_storageCreated = true;
+    }
+
+    PacketData batch[WRITER_BATCH_SIZE];
+    int count = 0;
+
+    while(count < WRITER_BATCH_SIZE && m_writerQueue.pop(batch[count])) {
+        count++;
+    }
+
+    if(count > 0) {
+        auto now = std::chrono::steady_clock::now();
+
+        for(int i = 0; i < count; i++) {
+            queueWait += std::chrono::duration_cast<std::chrono::microseconds>(now - batch[i].queued).count();
+        }
+
+        queuePackets += count;
+        writeCalls++;
+
+        write(batch, count);
+    }
+
+    if(!m_writerQueue.empty()) {
+        return true;
+    }
+
+    // notify the consumers about new data in the ringbuffer
+    if(count > 0 && m_writeCallback) {
+        m_writeCallback();
+    }
+
+    // leave the writer before checking the queue again, so
+    // a producer either sees the flag or we see its packet
+    m_scheduled.store(false);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    return !m_writerQueue.empty() && !m_scheduled.exchange(true);
+}
+
+size_t LiveQueue::backlog() const {
+    return m_writerQueue.size();
+}
+
+void LiveQueue::wakeupWriter() {
+    if(!m_scheduled.exchange(true)) {
+        TimeShiftWriter::instance().schedule(m_id);
+    }
+}
+
+void LiveQueue::createRingBuffer() {
+    // get our share of the timeshift budget
+    // segmented buffers limited by time may grow up to the budget
+    uint64_t maxSize = m_bufferSize;
+
+    if(m_storage->segmented() && m_maxDuration.count() > 0) {
+        maxSize = std::numeric_limits<off_t>::max();
+    }
+
+    m_size = TimeShiftManager::instance().attach(m_id, m_timeShiftDir, maxSize);
+    m_capacity = m_size;
+
+    off_t length = m_size + 1024 * 1024;
+
+    // use a preallocated file if available
+    m_fileName = TimeShiftPool::instance().acquire(length).c_str();
+
+    dsyslog("timeshift file: %s (%s storage)", (const char*)m_fileName, m_storage->name());
+
+    bool success = m_storage->open((const char*)m_fileName, length);
+
+    // fall back to plain file storage
+    if(!success && strcmp(m_storage->name(), "file") != 0) {
+        esyslog("%s storage failed - falling back to file storage", m_storage->name());
+        delete m_storage;
+        m_storage = TimeShiftStorage::create("file");
+
+        success = m_storage->open((const char*)m_fileName, length);
+    }
+
+    if(!success) {
+        esyslog("Failed to create timeshift ringbuffer !");
         return;
     }
 
-    // set queue start time
-    m_queueStartTime = roboTV::currentTimeMillis();
+    // readers don't touch the storage before it has been published
+    publish(0, 0);
+    WriteBackScheduler::instance().attach(m_id, m_storage);
+}
+
+int LiveQueue::readChunk(Cursor& cursor, std::vector<uint8_t>& buffer, size_t size, const std::function<bool(const Record&)>& visitor) {
+    static auto& chunks = roboTV::Statistics::instance().counter("live.reader.chunks");
+    static auto& chunkBytes = roboTV::Statistics::instance().counter("live.reader.chunkBytes");
 
-    m_writeThread = new std::thread([&]() {
-        createRingBuffer();
+    for(;;) {
+        int64_t bytes = available(cursor, m_state.load());
+
+        if(bytes <= 0) {
+            return 0;
+        }
+
+        size_t length = (size_t)std::min<int64_t>(bytes, std::max<size_t>(size, Record::HeaderLength));
+
+        if(buffer.size() < length) {
+            buffer.resize(length);
+        }
+
+        size_t count = m_storage->readData(cursor.position, buffer.data(), length);
+
+        // the first packet doesn't fit into the chunk
+        if(count >= Record::HeaderLength) {
+            size_t needed = Record::HeaderLength + Record::decode(buffer.data()).length;
+
+            if(needed > count && (int64_t)needed <= bytes) {
+                buffer.resize(needed);
+                count = m_storage->readData(cursor.position, buffer.data(), needed);
+            }
+        }
+
+        // the writer may have overwritten the chunk while we were
+        // reading it. retry with the current state.
+        if(!isValid(cursor, m_state.load())) {
+            continue;
+        }
 
-        while(m_writerRunning) {
+        chunks++;
+        chunkBytes += count;
 
-            while(m_writerRunning && !m_writerQueue.empty()) {
-                PacketData p{};
+        // walk the records in place
+        size_t offset = 0;
+        int records = 0;
 
-                {
-                    std::lock_guard<std::mutex> lock(m_mutexQueue);
-                    p = m_writerQueue.front();
-                    m_writerQueue.pop_front();
-                }
+        while(offset + Record::HeaderLength <= count) {
+            Record r = Record::decode(buffer.data() + offset);
 
-                write(p);
+            // incomplete record
+            if(offset + Record::HeaderLength + r.length > count) {
+                break;
             }
 
-            if(m_writerRunning) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            offset += Record::HeaderLength + r.length;
+            records++;
+
+            if(!visitor(r)) {
+                break;
             }
         }
-    });
 
+        cursor.position += offset;
+        return records;
+    }
 }
 
-void LiveQueue::createRingBuffer() {
-    std::lock_guard<std::mutex> lock(m_mutex);
+bool LiveQueue::readRange(Cursor& cursor, size_t minSize, size_t maxSize, TimeShiftStorage::FileRange& range) {
+    static auto& ranges = roboTV::Statistics::instance().counter("live.reader.ranges");
+    static auto& rangeBytes = roboTV::Statistics::instance().counter("live.reader.rangeBytes");
 
-    m_pause = false;
-    off_t length = (off_t)m_bufferSize + 1024 * 1024;
+    int64_t bytes = available(cursor, m_state.load());
 
-    m_storage = cString::sprintf("%s/robotv-ringbuffer-%05i.data", m_timeShiftDir.c_str(), m_socket);
-    dsyslog("timeshift file: %s", (const char*)m_storage);
+    // the range ends at a record boundary (the writer or a segment end).
+    // data in the range can't be overwritten while the range is referenced.
+    if(bytes <= 0 || !m_storage->fileRange(cursor.position, bytes, range)) {
+        return false;
+    }
 
-    m_writeFd = open(m_storage, O_CREAT | O_WRONLY, 0644);
-    int rc = posix_fallocate(m_writeFd, 0, length);
+    size_t length = range.length;
 
-    if(rc != 0) {
-        dsyslog("unable to pre-allocate %li bytes for timeshift ringbuffer", length);
-        dsyslog("ERROR: %s (status = %i)", strerror(rc), rc);
+    // not enough data yet
+    if(length == (size_t)bytes && length < minSize) {
+        range.owner.reset();
+        range.length = 0;
+        return true;
     }
 
-    m_readFd = open(m_storage, O_NOATIME | O_RDONLY, 0644);
+    // the records in between are unknown, end at the last sync point
+    if(length > maxSize) {
+        auto index = std::atomic_load(&m_indexSnapshot);
+        auto i = index->findByPosition(cursor.position + maxSize, cursor.wrapCount);
 
-    if(m_readFd == -1) {
-        esyslog("Failed to create timeshift ringbuffer !");
+        if(i == nullptr || i->wrapCount != cursor.wrapCount || i->position <= cursor.position) {
+            range.owner.reset();
+            return false;
+        }
+
+        length = i->position - cursor.position;
+    }
+
+    // too short (end of a segment)
+    if(length < minSize) {
+        range.owner.reset();
+        return false;
     }
 
-    lseek(m_readFd, 0, SEEK_SET);
-    lseek(m_writeFd, 0, SEEK_SET);
+    range.length = length;
+    cursor.position += length;
+
+    ranges++;
+    rangeBytes += length;
 
+    return true;
 }
 
-MsgPacket* LiveQueue::read() {
-    std::lock_guard<std::mutex> lock(m_mutex);
+int64_t LiveQueue::available(Cursor& cursor, const WriterState& state) {
+    static auto& overtaken = roboTV::Statistics::instance().counter("live.reader.overtaken");
 
-    if(m_pause) {
-        return nullptr;
+    if(state.writePosition == -1) {
+        return 0;
     }
 
-    return internalRead();
-}
+    // follow the writer into the next cycle
+    if(cursor.wrapCount == state.wrapCount - 1 && cursor.position >= state.wrapPosition) {
+        cursor.position = 0;
+        cursor.wrapCount++;
+    }
 
-MsgPacket* LiveQueue::internalRead() {
-    // check if read position wrapped
+    // the writer has overtaken the cursor
+    // -> continue at the start of the buffer
+    if(!isValid(cursor, state)) {
+        isyslog("timeshift: reader overtaken by writer");
+        overtaken++;
+        cursor = oldestCursor(state);
+    }
 
-    off_t readPosition = lseek(m_readFd, 0, SEEK_CUR);
-    off_t writePosition = lseek(m_writeFd, 0, SEEK_CUR);
+    // previous cycle - up to the wrap
+    if(cursor.wrapCount != state.wrapCount) {
+        return state.wrapPosition - cursor.position;
+    }
 
-    if(readPosition == (off_t)-1 || writePosition == (off_t)-1) {
-        return nullptr;
+    return state.writePosition - cursor.position;
+}
+
+bool LiveQueue::isValid(const Cursor& cursor, const WriterState& state) {
+    // same cycle - behind the writer
+    if(cursor.wrapCount == state.wrapCount) {
+        return (cursor.position <= state.overwritePosition && cursor.position >= state.startPosition);
     }
 
-    if(readPosition >= (off_t)m_bufferSize) {
-        isyslog("timeshift: read buffer wrap");
-        lseek(m_readFd, 0, SEEK_SET);
-        readPosition = 0;
-        m_wrapped = !m_wrapped;
-        isyslog("wrapped: %s", m_wrapped ? "yes" : "no");
+    // previous cycle - ahead of the data being written
+    if(cursor.wrapCount == state.wrapCount - 1) {
+        return (cursor.position >= state.overwritePosition);
     }
 
-    // check if read position is still behind write position (if not wrapped))
-    // if not -> skip packet (as we would start reading from the beginning of
-    // the buffer)
+    return false;
+}
 
-    if(readPosition >= writePosition && !m_wrapped) {
-        return nullptr;
-    }
+LiveQueue::Cursor LiveQueue::oldestCursor(const WriterState& state) {
+    auto index = std::atomic_load(&m_indexSnapshot);
 
-    // read packet from storage
-    auto p = MsgPacket::read(m_readFd, 1000);
+    // the snapshot may be older than the state
+    if(!index->empty()) {
+        auto& front = index->front();
+        Cursor cursor = { front.position, front.wrapCount };
 
-    // do not cache the packet anymore
-    if(p != nullptr) {
-        posix_fadvise(m_readFd, readPosition, p->getPacketLength(), POSIX_FADV_DONTNEED);
+        if(isValid(cursor, state)) {
+            return cursor;
+        }
     }
 
-    return p;
+    return { state.writePosition, (int)state.wrapCount };
 }
 
-bool LiveQueue::isPaused() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    return m_pause;
+LiveQueue::Cursor LiveQueue::liveCursor() {
+    auto index = std::atomic_load(&m_indexSnapshot);
+
+    // start at the latest sync point
+    if(!index->empty()) {
+        auto& i = index->back();
+        return { i.position, i.wrapCount };
+    }
+
+    WriterState state = m_state.load();
+    return { state.writePosition == -1 ? 0 : state.writePosition, (int)state.wrapCount };
 }
 
 void LiveQueue::queue(MsgPacket* p, StreamInfo::Content content, int64_t pts) {
-    start();
+    if(!accept(p, content) || !m_writerQueue.push({p, content, pts, std::chrono::steady_clock::now()})) {
+        drop(p, content);
+        return;
+    }
 
-    {
-        std::lock_guard<std::mutex> lock(m_mutexQueue);
+    wakeupWriter();
+}
+
+bool LiveQueue::accept(MsgPacket* p, StreamInfo::Content content) {
+    size_t fill = m_writerQueue.size();
+    size_t capacity = m_writerQueue.capacity();
 
-        if (m_writerQueue.size() >= 400) {
-            delete p;
-            return;
+    // ring full - if we lose a reference frame, the following
+    // frames are useless until the next keyframe
+    if(fill >= capacity) {
+        if(content == StreamInfo::Content::VIDEO) {
+            m_skipToKeyFrame = true;
         }
 
-        m_writerQueue.push_back({p, content, pts});
+        return false;
+    }
+
+    if(content != StreamInfo::Content::VIDEO) {
+        return true;
+    }
+
+    auto frameType = (StreamInfo::FrameType)p->getClientID();
+
+    if(frameType == StreamInfo::FrameType::IFRAME) {
+        m_skipToKeyFrame = false;
+        return true;
     }
+
+    if(m_skipToKeyFrame) {
+        return false;
+    }
+
+    // shed non-reference frames first
+    bool reference = (frameType != StreamInfo::FrameType::BFRAME && frameType != StreamInfo::FrameType::DFRAME);
+
+    if(!reference && fill >= capacity * 3 / 4) {
+        return false;
+    }
+
+    // keep the remaining headroom for keyframes
+    if(fill >= capacity * 7 / 8) {
+        m_skipToKeyFrame = true;
+        return false;
+    }
+
+    return true;
 }
 
-bool LiveQueue::write(const PacketData& data) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+void LiveQueue::drop(MsgPacket* p, StreamInfo::Content content) {
+    static auto& droppedI = roboTV::Statistics::instance().counter("live.drop.iframes");
+    static auto& droppedP = roboTV::Statistics::instance().counter("live.drop.pframes");
+    static auto& droppedB = roboTV::Statistics::instance().counter("live.drop.bframes");
+    static auto& droppedOther = roboTV::Statistics::instance().counter("live.drop.other");
 
-    auto timeStamp = roboTV::currentTimeMillis();
-    auto p = data.p;
-    auto content = data.content;
-    auto pts = data.pts;
+    auto frameType = (StreamInfo::FrameType)p->getClientID();
+    delete p;
 
+    if(content != StreamInfo::Content::VIDEO) {
+        droppedOther++;
+        return;
+    }
+
+    switch(frameType) {
+        case StreamInfo::FrameType::IFRAME:
+            droppedI++;
+            break;
+
+        case StreamInfo::FrameType::BFRAME:
+        case StreamInfo::FrameType::DFRAME:
+            droppedB++;
+            break;
+
+        default:
+            droppedP++;
+            break;
+    }
+}
+
+bool LiveQueue::write(PacketData* batch, int count) {
+    auto timeStamp = roboTV::currentTimeMillis();
 
     // first packet set start time
-    if(m_indexList.empty()) {
-        m_queueStartTime = roboTV::currentTimeMillis();
+    if(m_index.empty()) {
+        m_queueStartTime = timeStamp.count();
     }
 
-    // ring-buffer overrun ?
+    // record header and payload of every packet
+    uint8_t headers[WRITER_BATCH_SIZE][Record::HeaderLength];
+    struct iovec iov[2 * WRITER_BATCH_SIZE];
+    int iovcnt = 0;
+    bool success = true;
+
+    off_t writePosition = m_storage->writePosition();
 
-    off_t writePosition = lseek(m_writeFd, 0, SEEK_CUR);
+    // follow our share of the timeshift budget. if the buffer
+    // shrinks below the write position, it wraps immediately.
+    if(timeStamp - m_lastSizeUpdate >= std::chrono::milliseconds(SIZE_UPDATE_INTERVAL)) {
+        updateSize();
+        m_lastSizeUpdate = timeStamp;
+    }
+
+    for(int i = 0; i < count; i++) {
+        auto p = batch[i].p;
 
-    if(writePosition >= (off_t) m_bufferSize) {
-        isyslog("timeshift: write buffer wrap");
-        int rc = ftruncate(m_writeFd, (off_t)writePosition);
+        // segmented storage - start a new segment
+        if(m_storage->segmentFull(writePosition)) {
+            success &= writeVector(iov, iovcnt, writePosition);
+            iovcnt = 0;
 
-        if(rc == -1) {
-            esyslog("truncating the timeshift buffer failed: %i - %s", errno, strerror(errno));
+            m_storage->wrap();
         }
 
-        lseek(m_writeFd, 0, SEEK_SET);
-        writePosition = 0;
+        // ring-buffer overrun ?
+
+        else if(!m_storage->segmented() && writePosition >= m_size) {
+            // flush everything in front of the wrap
+            success &= writeVector(iov, iovcnt, writePosition);
+            iovcnt = 0;
 
-        m_wrapped = !m_wrapped;
-        m_hasWrapped = true;
-        m_wrapCount++;
+            isyslog("timeshift: write buffer wrap");
+            m_storage->wrap();
+            m_wrapPosition = writePosition;
+            writePosition = 0;
+            m_wrapCount++;
 
-        isyslog("wrapped: %s", m_wrapped ? "yes" : "no");
+            publish(0, 0);
+        }
+
+        addSyncPoint(p, batch[i].content, batch[i].pts, writePosition, timeStamp.count());
+
+        uint32_t length = p->getPayloadLength();
+        Record::encode(headers[i], p->getMsgID(), p->getClientID(), length);
+
+        iov[iovcnt].iov_base = headers[i];
+        iov[iovcnt].iov_len = Record::HeaderLength;
+        iovcnt++;
+
+        if(length > 0) {
+            iov[iovcnt].iov_base = p->getPayload();
+            iov[iovcnt].iov_len = length;
+            iovcnt++;
+        }
+
+        writePosition += Record::HeaderLength + length;
     }
 
-    off_t packetEndPosition = writePosition + p->getPacketLength();
-    off_t readPosition = lseek(m_readFd, 0, SEEK_CUR);
+    // write packets
+    success &= writeVector(iov, iovcnt, writePosition);
 
-    // check if write position is still behind read position (if wrapped)
-    // if not -> discard packet
+    // release old segments
+    if(m_storage->segmented()) {
+        m_storage->retain(m_size, m_maxDuration);
+        trim(writePosition);
 
-    while(packetEndPosition >= readPosition && m_wrapped) {
-        esyslog("write overlap - wrapped read position behind write position !");
-        delete p;
-        return false;
+        publish(writePosition, writePosition);
+        publishIndex();
+    }
+
+    for(int i = 0; i < count; i++) {
+        delete batch[i].p;
     }
 
-    trim(packetEndPosition);
+    return success;
+}
 
-    // add keyframe to map
-    bool keyFrame = (p->getClientID() == (uint16_t)StreamInfo::FrameType::IFRAME);
+void LiveQueue::addSyncPoint(MsgPacket* p, StreamInfo::Content content, int64_t pts, off_t position, int64_t timeStamp) {
+    if(content == StreamInfo::Content::VIDEO) {
+        m_hasVideo = true;
 
-    if(keyFrame && content == StreamInfo::Content::VIDEO) {
-        m_indexList.push_back({writePosition, timeStamp, pts, m_wrapCount});
+        // add keyframe to index
+        if(p->getClientID() == (uint16_t)StreamInfo::FrameType::IFRAME) {
+            m_index.add(position, m_wrapCount, timeStamp, pts);
+            m_indexChanged = true;
+        }
+
+        return;
+    }
+
+    // audio only streams (radio) - every audio frame is a sync point,
+    // record one per interval
+    if(m_hasVideo || content != StreamInfo::Content::AUDIO) {
+        return;
+    }
+
+    if(m_index.empty() || timeStamp - m_index.back().wallclockTime >= AUDIO_SYNC_INTERVAL) {
+        m_index.add(position, m_wrapCount, timeStamp, pts);
+        m_indexChanged = true;
+    }
+}
+
+bool LiveQueue::writeVector(struct iovec* iov, int iovcnt, off_t end) {
+    static auto& writeTime = roboTV::Statistics::instance().counter("live.writer.writeUs");
+
+    if(iovcnt == 0) {
+        return true;
     }
 
-    // write packet
-    bool success = p->write(m_writeFd, 1000);
+    size_t length = 0;
+
+    for(int i = 0; i < iovcnt; i++) {
+        length += iov[i].iov_len;
+    }
+
+    // drop all sync points overwritten by this write at once and
+    // announce the range before touching the storage. readers
+    // overtaken by the writer will be moved to the oldest sync
+    // point on their next read.
+    trim(end);
+
+    publish(end - length, end);
+    publishIndex();
+
+    auto start = std::chrono::steady_clock::now();
+    bool success = m_storage->write(iov, iovcnt);
+    writeTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    publish(end, end);
 
     if(!success) {
         esyslog("Unable to write packet into timeshift ringbuffer !");
+        return false;
     }
 
-    // sync every 2 seconds
-    // we just want to avoid delays of the write-back cache hitting
-    // us on buffer-wrap (or any other occasion)
-
-    std::chrono::milliseconds now = roboTV::currentTimeMillis();
+    // flushed to the disk in the background
+    WriteBackScheduler::instance().written(m_id, end - length, end);
+    return true;
+}
 
-    if(now - m_lastSyncTime >= std::chrono::milliseconds(2000)) {
-        if(fdatasync(m_writeFd) != 0) {
-            esyslog("Failed to sync timeshift ring-buffer !");
-        }
+void LiveQueue::publish(off_t writePosition, off_t overwritePosition) {
+    m_state.store({ writePosition, overwritePosition, m_wrapPosition, m_storage->startPosition(), m_wrapCount });
+}
 
-        m_lastSyncTime = now;
+void LiveQueue::publishIndex() {
+    if(!m_indexChanged) {
+        return;
     }
 
-    delete p;
-    return success;
+    // readers keep their snapshot until they are done with it
+    std::atomic_store(&m_indexSnapshot, std::make_shared<const TimeShiftIndex>(m_index));
+    m_indexChanged = false;
 }
 
 void LiveQueue::close() {
-    ::close(m_readFd);
-    ::close(m_writeFd);
+    m_storage->close();
 
-    if(*m_storage) {
-        unlink(m_storage);
+    // hand the file back for the next stream
+    // (segmented storage releases its segment files itself)
+    if(*m_fileName && !m_storage->segmented()) {
+        TimeShiftPool::instance().release(*m_fileName);
     }
 }
 
 void LiveQueue::trim(off_t position) {
-    if(!m_hasWrapped || m_indexList.empty()) {
+    // remove sync points overwritten by the writer
+    // (or released with the oldest segments)
+    bool trimmed = m_storage->segmented() ?
+                   m_index.trim(m_storage->startPosition(), m_wrapCount + 1) :
+                   m_index.trim(position, m_wrapCount);
+
+    if(!trimmed) {
         return;
     }
 
-    auto p = m_indexList.front();
-
-    if(p.filePosition < position && p.wrapCount < m_wrapCount) {
-        m_indexList.pop_front();
-    }
+    m_indexChanged = true;
 
-    if(!m_indexList.empty()) {
-        p = m_indexList.front();
-        m_queueStartTime = p.wallclockTime;
+    if(!m_index.empty()) {
+        m_queueStartTime = m_index.front().wallclockTime;
     }
 }
 
-bool LiveQueue::pause(bool on) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+void LiveQueue::updateSize() {
+    off_t size = TimeShiftManager::instance().share(m_id);
 
-    if(m_pause == on) {
-        return false;
+    if(size == 0) {
+        return;
     }
 
-    m_pause = on;
-    return true;
+    // the buffer can't grow beyond the preallocated space
+    if(!m_storage->resizable()) {
+        size = std::min(size, m_capacity);
+    }
+
+    m_size = size;
+}
+
+void LiveQueue::setViewers(int viewers) {
+    TimeShiftManager::instance().setViewers(m_id, viewers);
 }
 
 void LiveQueue::setTimeShiftDir(const cString& dir) {
@@ -326,66 +696,97 @@ void LiveQueue::setBufferSize(uint64_t s) {
     isyslog("timeshift buffersize: %lu bytes", m_bufferSize);
 }
 
-void LiveQueue::removeTimeShiftFiles() {
-    DIR* dir = opendir(m_timeShiftDir.c_str());
-
-    if(dir == nullptr) {
+void LiveQueue::setStorageBackend(const std::string& backend) {
+    if(!TimeShiftStorage::isValid(backend)) {
+        esyslog("unknown timeshift backend '%s'", backend.c_str());
         return;
     }
 
-    struct dirent* entry = nullptr;
+    m_storageBackend = backend;
+    isyslog("timeshift backend: %s", m_storageBackend.c_str());
+}
 
-    while((entry = readdir(dir)) != nullptr) {
-        if(strncmp(entry->d_name, "robotv-ringbuffer-", 16) == 0) {
-            isyslog("Removing old time-shift storage: %s", entry->d_name);
-            unlink(AddDirectory(m_timeShiftDir.c_str(), entry->d_name));
-        }
-    }
+void LiveQueue::setRamSize(uint64_t s) {
+    m_ramSize = s;
+    isyslog("timeshift RAM tier: %lu bytes", m_ramSize);
+}
 
-    closedir(dir);
+void LiveQueue::setHugePages(bool on) {
+    m_hugePages = on;
 }
 
-int64_t LiveQueue::seek(int64_t wallclockPositionMs) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+void LiveQueue::setSegmentSize(uint64_t s) {
+    m_segmentSize = s;
+    isyslog("timeshift segment size: %lu bytes", m_segmentSize);
+}
+
+void LiveQueue::setMaxDuration(int seconds) {
+    m_maxDuration = std::chrono::milliseconds(seconds * 1000);
+    isyslog("timeshift duration: %i seconds", seconds);
+}
 
+void LiveQueue::startFilePool() {
+    off_t size = (m_segmentSize > 0 && m_ramSize == 0) ? m_segmentSize : m_bufferSize;
+    TimeShiftPool::instance().start(m_timeShiftDir, size + 1024 * 1024);
+}
+
+void LiveQueue::stopFilePool() {
+    TimeShiftPool::instance().stop();
+}
+
+int64_t LiveQueue::seek(Cursor& cursor, int64_t wallclockPositionMs) {
     isyslog("seek: %lu", wallclockPositionMs);
 
-    auto s = m_indexList.rbegin();
-    auto e = m_indexList.rend();
-    auto h = m_indexList.begin();
+    auto index = std::atomic_load(&m_indexSnapshot);
+    auto i = index->findByTime(wallclockPositionMs);
 
-    if(s == e) {
+    if(i == nullptr) {
         esyslog("empty timeshift queue - unable to seek");
         return 0;
     }
 
-    // ahead of buffer
-    if(wallclockPositionMs >= s->wallclockTime.count()) {
-        lseek(m_readFd, s->filePosition, SEEK_SET);
-        return s->pts;
+    cursor = { i->position, i->wrapCount };
+    return i->pts;
+}
+
+int64_t LiveQueue::catchUp(Cursor& cursor, std::chrono::milliseconds maxLag) {
+    static auto& catchUps = roboTV::Statistics::instance().counter("live.reader.catchUps");
+    static auto& skippedTime = roboTV::Statistics::instance().counter("live.reader.catchUpMs");
+
+    auto index = std::atomic_load(&m_indexSnapshot);
+
+    if(index->empty()) {
+        return 0;
     }
 
-    // behind buffer
-    else if(wallclockPositionMs <= h->wallclockTime.count()) {
-        lseek(m_readFd, h->filePosition, SEEK_SET);
-        return h->pts;
+    // sync point in front of the cursor
+    auto i = index->findByPosition(cursor.position, cursor.wrapCount);
+    auto& latest = index->back();
+
+    if(i == nullptr || i == &latest) {
+        return 0;
     }
 
-    // in between ?
-    while(s != e) {
-        if(s->wallclockTime.count() <= wallclockPositionMs) {
-            lseek(m_readFd, s->filePosition, SEEK_SET);
-            return s->pts;
-        }
+    int64_t lag = latest.wallclockTime - i->wallclockTime;
 
-        s++;
+    if(lag <= maxLag.count()) {
+        return 0;
     }
 
-    // not found
-    esyslog("fileposition not found!");
-    return 0;
+    isyslog("timeshift: reader %li ms behind live - skipping to the latest sync point", lag);
+
+    cursor = { latest.position, latest.wrapCount };
+
+    catchUps++;
+    skippedTime += lag;
+
+    return lag;
+}
+
+void LiveQueue::setWriteCallback(std::function<void()> callback) {
+    m_writeCallback = callback;
 }
 
 int64_t LiveQueue::getTimeshiftStartPosition() {
-    return m_queueStartTime.count();
+    return m_queueStartTime;
 }
@@ -26,12 +26,19 @@
 #define ROBOTV_LIVEQUEUE_H
 
 #include "robotvdmx/streaminfo.h"
+#include "timeshiftindex.h"
+#include "timeshiftrecord.h"
+#include "timeshiftstorage.h"
+#include "tools/seqlock.h"
+#include "tools/spscring.h"
 
 #include <deque>
+#include <functional>
 #include <chrono>
 #include <mutex>
 #include <list>
-#include <thread>
+#include <memory>
+#include <vector>
 #include <atomic>
 
 class MsgPacket;
@@ -39,46 +46,125 @@ class MsgPacket;
 class LiveQueue {
 public:
 
-    LiveQueue(int socket);
+    /**
+     * Read position of a consumer.
+     * Every consumer of the queue keeps its own cursor.
+     */
+    struct Cursor {
+        off_t position;
+        int wrapCount;
+    };
+
+    typedef TimeShiftRecord Record;
+
+    LiveQueue(int id);
 
     virtual ~LiveQueue();
 
     void queue(MsgPacket* p, StreamInfo::Content content, int64_t pts = 0);
 
-    MsgPacket* read();
+    /**
+     * Read consecutive packets in one go.
+     * Reads a chunk of the timeshift buffer into the given buffer and
+     * passes the records in place, without creating packets. The cursor
+     * is moved behind the last record passed.
+     * @param cursor read position of the consumer
+     * @param buffer buffer for the chunk (reused by the caller)
+     * @param size chunk size (the chunk grows if a single packet is larger)
+     * @param visitor called for every record, returns false to stop
+     * @return number of records passed
+     */
+    int readChunk(Cursor& cursor, std::vector<uint8_t>& buffer, size_t size, const std::function<bool(const Record&)>& visitor);
+
+    /**
+     * Get consecutive records as a range of the timeshift file.
+     * The range can be sent without copying the data. The cursor is
+     * moved behind the range.
+     * @param cursor read position of the consumer
+     * @param minSize minimum size of the range
+     * @param maxSize maximum size of the range
+     * @param range file range (a length of 0 if less than minSize bytes are available)
+     * @return false if the data isn't available as a file range (use readChunk)
+     */
+    bool readRange(Cursor& cursor, size_t minSize, size_t maxSize, TimeShiftStorage::FileRange& range);
+
+    int64_t seek(Cursor& cursor, int64_t wallclockPositionMs);
+
+    /**
+     * Move a cursor lagging behind live to the latest sync point.
+     * @param cursor read position of the consumer
+     * @param maxLag maximum distance to the latest sync point
+     * @return skipped time in ms (0 if the cursor hasn't been moved)
+     */
+    int64_t catchUp(Cursor& cursor, std::chrono::milliseconds maxLag);
+
+    Cursor liveCursor();
 
-    int64_t seek(int64_t wallclockPositionMs);
+    static void setTimeShiftDir(const cString& dir);
 
-    bool pause(bool on = true);
+    static void setBufferSize(uint64_t s);
 
-    bool isPaused();
+    static void setStorageBackend(const std::string& backend);
 
-    static void setTimeShiftDir(const cString& dir);
+    static void setRamSize(uint64_t s);
 
-    static void setBufferSize(uint64_t s);
+    static void setHugePages(bool on);
+
+    static void setSegmentSize(uint64_t s);
 
-    static void removeTimeShiftFiles();
+    static void setMaxDuration(int seconds);
+
+    static void startFilePool();
+
+    static void stopFilePool();
 
     int64_t getTimeshiftStartPosition();
 
+    void setWriteCallback(std::function<void()> callback);
+
+    void setViewers(int viewers);
+
+    /**
+     * Write the next batch of queued packets (writer thread).
+     * @return true if there are more packets to write
+     */
+    bool writeBatch();
+
+    /**
+     * Get the number of packets waiting to be written.
+     * @return number of packets
+     */
+    size_t backlog() const;
+
     struct PacketData {
         MsgPacket* p;
         StreamInfo::Content content;
         int64_t pts;
+        std::chrono::steady_clock::time_point queued;
     };
 
 protected:
 
-    struct PacketIndex {
-        off_t filePosition;
-        std::chrono::milliseconds wallclockTime;
-        int64_t pts;
-        int wrapCount;
+    /**
+     * Writer state published to the readers.
+     * Readers never lock the writer, they validate their cursor
+     * against a consistent snapshot of this state.
+     */
+    struct WriterState {
+        int64_t writePosition;      // end of the written data (-1 = no storage)
+        int64_t overwritePosition;  // end of the data currently being written
+        int64_t wrapPosition;       // end of the previous cycle
+        int64_t startPosition;      // oldest data (segmented storage)
+        int64_t wrapCount;
     };
 
-    bool write(const PacketData& data);
+    bool write(PacketData* batch, int count);
 
-    void start();
+    bool writeVector(struct iovec* iov, int iovcnt, off_t end);
+
+    void publish(off_t writePosition, off_t overwritePosition);
+
+    void publishIndex();
 
     void createRingBuffer();
 
@@ -86,47 +172,77 @@ protected:
 
     void trim(off_t position);
 
-    MsgPacket* internalRead();
+    void updateSize();
+
+    void addSyncPoint(MsgPacket* p, StreamInfo::Content content, int64_t pts, off_t position, int64_t timeStamp);
+
+    bool isValid(const Cursor& cursor, const WriterState& state);
 
-    void seekNextKeyFrame();
+    int64_t available(Cursor& cursor, const WriterState& state);
 
-    std::deque<struct PacketIndex> m_indexList;
+    Cursor oldestCursor(const WriterState& state);
 
-    int m_readFd;
+    // index of the writer and the snapshot shared with the readers
+    TimeShiftIndex m_index;
 
-    int m_writeFd;
+    bool m_indexChanged;
 
-    int m_socket;
+    std::shared_ptr<const TimeShiftIndex> m_indexSnapshot;
 
-    bool m_pause;
+    roboTV::SeqLock<WriterState> m_state;
 
-    std::mutex m_mutex;
+    bool m_hasVideo;
 
-    cString m_storage;
+    int m_id;
 
-    std::chrono::milliseconds m_queueStartTime;
+    TimeShiftStorage* m_storage;
 
-    bool m_wrapped;
+    cString m_fileName;
 
-    bool m_hasWrapped;
+    std::atomic<int64_t> m_queueStartTime;
 
     int m_wrapCount;
 
+    off_t m_wrapPosition;
+
+    off_t m_size;
+
+    off_t m_capacity;
+
+    std::chrono::milliseconds m_lastSizeUpdate;
+
     static std::string m_timeShiftDir;
 
     static uint64_t m_bufferSize;
 
+    static std::string m_storageBackend;
+
+    static uint64_t m_ramSize;
+
+    static bool m_hugePages;
+
+    static uint64_t m_segmentSize;
+
+    static std::chrono::milliseconds m_maxDuration;
+
 private:
 
-    std::thread* m_writeThread;
+    bool accept(MsgPacket* p, StreamInfo::Content content);
+
+    void drop(MsgPacket* p, StreamInfo::Content content);
+
+    void wakeupWriter();
+
+    roboTV::SpscRing<PacketData> m_writerQueue;
 
-    std::atomic<bool> m_writerRunning;
+    bool m_skipToKeyFrame;
 
-    std::chrono::milliseconds m_lastSyncTime;
+    // queued for the writer threads or being written
+    std::atomic<bool> m_scheduled;
 
-    std::deque<PacketData> m_writerQueue;
+    bool m_storageCreated;
 
-    std::mutex m_mutexQueue;
+    std::function<void()> m_writeCallback;
 
 };
 
@@ -0,0 +1,223 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <algorithm>
+#include <vector>
+#include <vdr/tools.h>
+
+#include "livesessions.h"
+#include "livestreamer.h"
+#include "tools/statistics.h"
+
+LiveSessions::LiveSessions() : m_gracePeriod(30), m_running(false), m_thread(nullptr) {
+}
+
+LiveSessions::~LiveSessions() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+
+    m_cond.notify_all();
+
+    if(m_thread != nullptr) {
+        m_thread->join();
+    }
+
+    delete m_thread;
+    clear();
+}
+
+LiveSessions& LiveSessions::instance() {
+    static LiveSessions sessions;
+    return sessions;
+}
+
+void LiveSessions::setGracePeriod(int seconds) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_gracePeriod = std::chrono::seconds(seconds);
+    isyslog("live session grace period: %i seconds", seconds);
+}
+
+uint64_t LiveSessions::createToken() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if(m_gracePeriod.count() == 0) {
+        return 0;
+    }
+
+    // the token is the only credential of a session, so it must not be
+    // predictable. take it straight from the system's entropy source.
+    uint64_t token = 0;
+
+    while(token == 0 || m_sessions.find(token) != m_sessions.end()) {
+        token = ((uint64_t)m_random() << 32) | m_random();
+    }
+
+    return token;
+}
+
+void LiveSessions::attach(uint64_t token, const void* owner, const std::function<LiveStreamer*()>& takeOver) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if(token == 0) {
+        return;
+    }
+
+    m_owners[token] = { owner, takeOver };
+}
+
+void LiveSessions::detach(uint64_t token, const void* owner) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto i = m_owners.find(token);
+
+    // the session may have been taken over by another client
+    if(i != m_owners.end() && i->second.owner == owner) {
+        m_owners.erase(i);
+    }
+}
+
+bool LiveSessions::park(uint64_t token, LiveStreamer* streamer) {
+    static auto& parked = roboTV::Statistics::instance().counter("live.session.parked");
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if(token == 0 || m_gracePeriod.count() == 0) {
+        return false;
+    }
+
+    m_sessions[token] = { streamer, Clock::now() + m_gracePeriod };
+    parked++;
+
+    isyslog("live session %016llx kept for %li seconds", (unsigned long long)token, (long)m_gracePeriod.count());
+
+    if(m_thread == nullptr) {
+        m_running = true;
+        m_thread = new std::thread([&]() {
+            run();
+        });
+    }
+
+    m_cond.notify_all();
+    return true;
+}
+
+LiveStreamer* LiveSessions::resume(uint64_t token) {
+    static auto& resumed = roboTV::Statistics::instance().counter("live.session.resumed");
+    static auto& takenOver = roboTV::Statistics::instance().counter("live.session.takenOver");
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if(token == 0) {
+        return nullptr;
+    }
+
+    auto i = m_sessions.find(token);
+
+    if(i != m_sessions.end()) {
+        LiveStreamer* streamer = i->second.streamer;
+        m_sessions.erase(i);
+        resumed++;
+
+        isyslog("live session %016llx resumed", (unsigned long long)token);
+        return streamer;
+    }
+
+    // the lost connection hasn't been noticed yet
+    auto o = m_owners.find(token);
+
+    if(o == m_owners.end()) {
+        return nullptr;
+    }
+
+    std::function<LiveStreamer*()> takeOver = o->second.takeOver;
+    m_owners.erase(o);
+
+    LiveStreamer* streamer = takeOver();
+
+    if(streamer != nullptr) {
+        takenOver++;
+        isyslog("live session %016llx taken over from the previous connection", (unsigned long long)token);
+    }
+
+    return streamer;
+}
+
+void LiveSessions::clear() {
+    std::map<uint64_t, Session> sessions;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        sessions.swap(m_sessions);
+    }
+
+    for(auto& i : sessions) {
+        delete i.second.streamer;
+    }
+}
+
+void LiveSessions::run() {
+    static auto& expired = roboTV::Statistics::instance().counter("live.session.expired");
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while(m_running) {
+        auto now = Clock::now();
+        auto next = Clock::time_point::max();
+        std::vector<LiveStreamer*> streamers;
+
+        for(auto i = m_sessions.begin(); i != m_sessions.end();) {
+            if(i->second.expires <= now) {
+                isyslog("live session %016llx expired", (unsigned long long)i->first);
+                streamers.push_back(i->second.streamer);
+                i = m_sessions.erase(i);
+                continue;
+            }
+
+            next = std::min(next, i->second.expires);
+            i++;
+        }
+
+        // tearing down the channel takes a while, don't block the clients
+        if(!streamers.empty()) {
+            lock.unlock();
+
+            for(auto streamer : streamers) {
+                delete streamer;
+                expired++;
+            }
+
+            lock.lock();
+            continue;
+        }
+
+        if(next == Clock::time_point::max()) {
+            m_cond.wait(lock);
+        }
+        else {
+            m_cond.wait_until(lock, next);
+        }
+    }
+}
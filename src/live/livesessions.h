@@ -0,0 +1,146 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_LIVESESSIONS_H
+#define ROBOTV_LIVESESSIONS_H
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+class LiveStreamer;
+
+/**
+ * Live sessions of lost connections.
+ * The streamer of a client losing its connection is kept alive (tuner,
+ * timeshift buffer and position) for a grace period. A reconnecting
+ * client resumes the session with the token it got when opening the
+ * stream. Sessions not resumed in time are torn down.
+ * A connection may be lost without the server noticing (no FIN / RST),
+ * so a reconnecting client may also take over the session of a client
+ * that is still connected.
+ */
+class LiveSessions {
+public:
+
+    static LiveSessions& instance();
+
+    ~LiveSessions();
+
+    /**
+     * Set the grace period of lost sessions.
+     * @param seconds grace period (0 = disabled)
+     */
+    void setGracePeriod(int seconds);
+
+    /**
+     * Create a token for a new session.
+     * @return session token (0 if sessions are disabled)
+     */
+    uint64_t createToken();
+
+    /**
+     * Register the session of a connected client.
+     * The take over function is called with the session lock held, so
+     * the owner must not call into the sessions while holding a lock the
+     * function takes.
+     * @param token session token
+     * @param owner owner of the session
+     * @param takeOver detaches the streamer from the owner and returns it
+     */
+    void attach(uint64_t token, const void* owner, const std::function<LiveStreamer*()>& takeOver);
+
+    /**
+     * Unregister the session of a connected client.
+     * @param token session token
+     * @param owner owner of the session
+     */
+    void detach(uint64_t token, const void* owner);
+
+    /**
+     * Keep the streamer of a lost connection.
+     * The session takes the ownership of the streamer.
+     * @param token session token
+     * @param streamer detached streamer
+     * @return false if the session can't be kept (the streamer isn't taken)
+     */
+    bool park(uint64_t token, LiveStreamer* streamer);
+
+    /**
+     * Take the streamer of a lost session.
+     * The session of a still connected client is taken over.
+     * @param token session token
+     * @return streamer of the session (nullptr if unknown or expired)
+     */
+    LiveStreamer* resume(uint64_t token);
+
+    /**
+     * Tear down all lost sessions.
+     */
+    void clear();
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Session {
+        LiveStreamer* streamer;
+        Clock::time_point expires;
+    };
+
+    struct Owner {
+        const void* owner;
+        std::function<LiveStreamer*()> takeOver;
+    };
+
+    LiveSessions();
+
+    void run();
+
+    std::map<uint64_t, Session> m_sessions;
+
+    // sessions of connected clients
+    std::map<uint64_t, Owner> m_owners;
+
+    std::chrono::seconds m_gracePeriod;
+
+    std::random_device m_random;
+
+    bool m_running;
+
+    std::thread* m_thread;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_cond;
+
+};
+
+#endif // ROBOTV_LIVESESSIONS_H
@@ -23,164 +23,135 @@
  */
 
 #include <stdlib.h>
-#include <vdr/remux.h>
-#include <vdr/timers.h>
-
-#ifdef __FreeBSD__
-#include <sys/endian.h>
-#else
-#include <endian.h>
-#endif
 
 #include "config/config.h"
 #include "net/msgpacket.h"
 #include "robotv/robotvcommand.h"
 #include "robotv/robotvclient.h"
-#include "tools/hash.h"
+#include "tools/statistics.h"
 #include "tools/time.h"
 
 #include "livestreamer.h"
+#include "livechannel.h"
 #include "livequeue.h"
-#include "channelcache.h"
 
 #include <chrono>
-#include <robotv/StreamPacketProcessor.h>
 
 #define MIN_PACKET_SIZE (128 * 1024)
+#define AGGREGATE_HEADROOM (32 * 1024)
+#define AGGREGATE_HEADER_SIZE 16
+
+// maximum size of a range sent from the timeshift file
+#define MAX_RANGE_SIZE (4 * 1024 * 1024)
 
 using namespace std::chrono;
 
+std::chrono::milliseconds LiveStreamer::m_maxLiveLag(0);
+
 LiveStreamer::LiveStreamer(RoboTvClient* parent, int priority)
-    : cReceiver(nullptr, priority)
+    : m_cursor{0, 0}
     , m_parent(parent)
-    , m_uid(0) {
-    // create send queue
-    m_queue = new LiveQueue(m_parent->getSocket());
+    , m_priority(priority)
+    , m_paused(false)
+    , m_timeshift(false)
+    , m_push(false)
+    , m_waiting(false)
+    , m_credits(0) {
 }
 
 LiveStreamer::~LiveStreamer() {
-    cDevice * device = Device();
+    if(m_channel) {
+        m_channel->removeViewer(this);
+    }
 
-    if(device != nullptr) {
-        cCamSlot *camSlot = device->CamSlot();
+    // the last viewer tears down the channel
+    m_channel.reset();
 
-        if (camSlot != nullptr) {
-            isyslog("camslot detached");
-            ChannelCamRelations.ClrChecked(ChannelID(), camSlot->SlotNumber());
-        }
+    delete m_streamPacket;
 
-        Detach();
+    for(auto p : m_control) {
+        delete p;
     }
 
-    reset();
-    delete m_queue;
-    delete m_streamPacket;
-
     isyslog("live streamer terminated");
 }
 
 int LiveStreamer::switchChannel(const cChannel* channel) {
-    if(channel == nullptr) {
-        esyslog("unknown channel !");
-        return ROBOTV_RET_ERROR;
-    }
-
-    // get device for this channel
-    cDevice* device = cDevice::GetDevice(channel, LIVEPRIORITY, false);
-
-    // maybe an encrypted channel that cannot be handled
-    // lets try if a device can decrypt it on it's own (without a CAM slot)
-    if(device == nullptr) {
-        device = cDevice::GetDeviceForTransponder(channel, LIVEPRIORITY);
-    }
+    int status = ROBOTV_RET_ERROR;
+    std::shared_ptr<LiveChannel> liveChannel = LiveChannel::open(channel, m_priority, m_language, m_langStreamType, status);
 
-    // maybe all devices busy
-    if(device == nullptr) {
-        esyslog("No device available !");
-        return ROBOTV_RET_DATALOCKED;
+    if(!liveChannel) {
+        return status;
     }
 
-    isyslog("Found available device %d", device->DeviceNumber() + 1);
+    // a joining viewer needs the current stream information first
+    MsgPacket* streamChange = liveChannel->getStreamChange();
+    LiveQueue::Cursor cursor = liveChannel->queue()->liveCursor();
 
-    if(!device->SwitchChannel(channel, false)) {
-        esyslog("Can't switch to channel %i - %s", channel->Number(), channel->Name());
-        return ROBOTV_RET_ERROR;
+    // the channel notifies its viewers with the channel lock held,
+    // so don't call into the channel while holding our own lock
+    if(m_channel) {
+        m_channel->removeViewer(this);
     }
 
-    m_uid = roboTV::Hash::createChannelUid(channel);
+    std::shared_ptr<LiveChannel> previous = m_channel;
 
-    StreamBundle currentItem = createFromChannel(channel);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
 
-    // get cached demuxer data
-    ChannelCache &cache = ChannelCache::instance();
-    StreamBundle cacheItem = cache.lookup(m_uid);
+        m_channel = liveChannel;
+        m_cursor = cursor;
+        m_timeshift = false;
 
-    // channel already in cache
-    if (!cacheItem.empty()) {
-        isyslog("Channel information found in cache");
-    }
-    // channel not found in cache -> add it from vdr
-    else {
-        isyslog("adding channel to cache");
-        cacheItem = currentItem;
-        cache.add(m_uid, cacheItem);
+        if(streamChange != nullptr) {
+            m_control.push_back(streamChange);
+        }
     }
 
-    // recheck cache item
-    if (!currentItem.isMetaOf(cacheItem)) {
-        isyslog("current channel differs from cache item - updating");
-        cacheItem = currentItem;
-        cache.add(m_uid, cacheItem);
-    }
+    m_channel->addViewer(this);
+    return ROBOTV_RET_OK;
+}
 
-    if(cacheItem.empty()) {
-        esyslog("channel %i - %s doesn't have any stream information", channel->Number(), channel->Name());
-        return false;
+void LiveStreamer::detach() {
+    // no more pushes to the client once we're gone from the channel
+    if(m_channel) {
+        m_channel->removeViewer(this);
     }
 
-    isyslog("Creating demuxers");
-    createDemuxers(&cacheItem);
-
-    onStreamChange();
-
-    isyslog("Successfully switched to channel %i - %s", channel->Number(), channel->Name());
+    std::lock_guard<std::mutex> pushLock(m_pushMutex);
+    std::lock_guard<std::mutex> lock(m_mutex);
 
-    // fool device to not start the decryption timer
-    int priority = Priority();
-    SetPriority(MINPRIORITY);
+    m_parent = nullptr;
+    m_push = false;
+    m_waiting = false;
+    m_credits = 0;
+}
 
-    /// attach receiver
-    if (device->AttachReceiver(this) == false) {
-        esyslog("failed to attach receiver !");
-        return false;
+void LiveStreamer::attach(RoboTvClient* parent, uint32_t credits) {
+    if(!m_channel) {
+        return;
     }
 
-    // start decrypting manually
-    cCamSlot* slot = device->CamSlot();
+    // the new connection needs the current stream information first
+    MsgPacket* streamChange = m_channel->getStreamChange();
 
-    if(slot) {
-        slot->StartDecrypting();
-    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
 
-    SetPriority(priority);
+        m_parent = parent;
+        enablePush(credits);
 
-    isyslog("done switching.");
-    return ROBOTV_RET_OK;
-}
-
-MsgPacket *LiveStreamer::createStreamChangePacket(DemuxerBundle &bundle) {
-    StreamBundle cache;
+        // the pending aggregate belongs to the lost connection
+        delete m_streamPacket;
+        m_streamPacket = nullptr;
 
-    for(auto i = bundle.begin(); i != bundle.end(); i++) {
-        cache.addStream(*(*i));
+        if(streamChange != nullptr) {
+            m_control.push_front(streamChange);
+        }
     }
 
-    ChannelCache::instance().add(m_uid, cache);
-
-    // reorder streams as preferred
-    bundle.reorderStreams(m_language.c_str(), m_langStreamType);
-
-    return StreamPacketProcessor::createStreamChangePacket(bundle);
+    m_channel->addViewer(this);
+    pushPackets();
 }
 
 void LiveStreamer::sendStatus(int status) {
@@ -190,244 +161,273 @@ void LiveStreamer::sendStatus(int status) {
 }
 
 void LiveStreamer::requestSignalInfo() {
-    cDevice* device = Device();
-
-    if(device == nullptr || !IsAttached()) {
+    // do not send (and pollute the client with) signal information
+    // if we are paused
+    if(!m_channel || isPaused()) {
         return;
     }
 
-    // do not send (and pollute the client with) signal information
-    // if we are paused
-    if(isPaused()) {
+    MsgPacket* resp = m_channel->createSignalInfo();
+
+    if(resp == nullptr) {
         return;
     }
 
-    MsgPacket* resp = new MsgPacket(ROBOTV_STREAM_SIGNALINFO, ROBOTV_CHANNEL_STREAM);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_control.push_back(resp);
+}
 
-    int DeviceNumber = device->DeviceNumber() + 1;
-    int Strength = 0;
-    int Quality = 0;
+void LiveStreamer::setLanguage(const char* lang, StreamInfo::Type streamtype) {
+    if(lang == nullptr) {
+        return;
+    }
 
-    Strength = device->SignalStrength();
-    Quality = device->SignalQuality();
+    m_language = lang;
+    m_langStreamType = streamtype;
+}
 
-    resp->put_String(*cString::sprintf(
-                         "%s #%d - %s",
-                         (const char*)device->DeviceType(),
-                         DeviceNumber,
-                         (const char*)device->DeviceName()));
+bool LiveStreamer::isPaused() {
+    return m_paused;
+}
 
-    // Quality:
-    // 4 - NO LOCK
-    // 3 - NO SYNC
-    // 2 - NO VITERBI
-    // 1 - NO CARRIER
-    // 0 - NO SIGNAL
+void LiveStreamer::pause(bool on) {
+    m_paused = on;
 
-    if(Quality == -1) {
-        resp->put_String("UNKNOWN (Incompatible device)");
-        Quality = 0;
-    }
-    else {
-        resp->put_String(*cString::sprintf("%s:%s:%s:%s:%s",
-                                           (Quality > 4) ? "LOCKED" : "-",
-                                           (Quality > 0) ? "SIGNAL" : "-",
-                                           (Quality > 1) ? "CARRIER" : "-",
-                                           (Quality > 2) ? "VITERBI" : "-",
-                                           (Quality > 3) ? "SYNC" : "-"));
+    // the viewer stays behind live after a pause
+    if(on) {
+        m_timeshift = true;
     }
 
-    resp->put_U32((Strength << 16) / 100);
-    resp->put_U32((Quality << 16) / 100);
-    resp->put_U32(0);
-    resp->put_U32(0);
+    // deliver the packets queued up during the pause
+    if(!on) {
+        pushPackets();
+    }
+}
 
-    // get provider & service information
-    LOCK_CHANNELS_READ;
-    const cChannel* channel = roboTV::Hash::findChannelByUid(Channels, m_uid);
+MsgPacket* LiveStreamer::requestPacket() {
+    std::lock_guard<std::mutex> lock(m_mutex);
 
-    if(channel != nullptr) {
-        // put in provider name
-        resp->put_String(channel->Provider());
+    MsgPacket* result = aggregatePacket();
 
-        // what the heck should be the service name ?
-        // using PortalName for now
-        resp->put_String(channel->PortalName());
-    }
-    else {
-        resp->put_String("");
-        resp->put_String("");
+    if(result == nullptr && isPaused()) {
+        result = m_streamPacket;
+        m_streamPacket = nullptr;
     }
 
-    dsyslog("RequestSignalInfo");
-    m_queue->queue(resp, StreamInfo::Content::NONE);
+    return result;
 }
 
-void LiveStreamer::setLanguage(const char* lang, StreamInfo::Type streamtype) {
-    if(lang == nullptr) {
+void LiveStreamer::setWaiting(bool on) {
+    m_waiting = on;
+}
+
+void LiveStreamer::enablePush(uint32_t credits) {
+    if(credits == 0) {
         return;
     }
 
-    m_language = lang;
-    m_langStreamType = streamtype;
+    m_push = true;
+    m_credits = credits;
 }
 
-bool LiveStreamer::isPaused() {
-    if(m_queue == nullptr) {
-        return false;
+void LiveStreamer::addCredits(uint32_t credits) {
+    if(!m_push) {
+        return;
     }
 
-    return m_queue->isPaused();
+    m_credits += credits;
+    pushPackets();
 }
 
-void LiveStreamer::pause(bool on) {
-    if(m_queue == nullptr) {
+void LiveStreamer::requestPush() {
+    // called from the queue writer - leave the work to the client worker
+    if((m_push || m_waiting) && m_parent != nullptr) {
+        m_parent->requestPush();
+    }
+}
+
+void LiveStreamer::pushPackets() {
+    if(!m_push) {
         return;
     }
 
-    m_queue->pause(on);
+    // called from client requests (credits, pause) and pushes
+    std::lock_guard<std::mutex> pushLock(m_pushMutex);
+
+    while(m_credits > 0) {
+        MsgPacket* p = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if(isPaused() || !m_channel) {
+                return;
+            }
+
+            p = aggregatePacket();
+
+            // flush partial aggregates that have been waiting too long
+            if(p == nullptr &&
+               m_streamPacket->getPayloadLength() > AGGREGATE_HEADER_SIZE &&
+               roboTV::currentTimeMillis() - m_streamPacketTime >= std::chrono::milliseconds(PUSH_MAX_DELAY)) {
+                p = m_streamPacket;
+                m_streamPacket = nullptr;
+            }
+        }
+
+        if(p == nullptr) {
+            return;
+        }
+
+        p->setMsgID(sendRecords() ? ROBOTV_STREAM_RECORDS : ROBOTV_STREAM_PACKETS);
+        p->setType(ROBOTV_CHANNEL_STREAM);
+
+        m_credits--;
+        m_parent->queueMessage(p);
+    }
 }
 
-MsgPacket* LiveStreamer::requestPacket() {
-    std::lock_guard<std::mutex> lock(m_mutex);
+MsgPacket* LiveStreamer::aggregatePacket() {
+    static auto& aggregateAge = roboTV::Statistics::instance().counter("live.aggregate.ageMs");
+    static auto& aggregates = roboTV::Statistics::instance().counter("live.aggregate.count");
+
+    if(!m_channel) {
+        return nullptr;
+    }
+
+    LiveQueue* queue = m_channel->queue();
 
     // create payload packet
     if(m_streamPacket == nullptr) {
-        m_streamPacket = new MsgPacket();
-        m_streamPacket->put_S64(m_queue->getTimeshiftStartPosition());
-        m_streamPacket->put_S64(roboTV::currentTimeMillis().count());
+        m_streamPacketTime = roboTV::currentTimeMillis();
+        m_streamPacket = new MsgPacket(0, 0, 0, MIN_PACKET_SIZE + AGGREGATE_HEADROOM);
+        m_streamPacket->put_S64(queue->getTimeshiftStartPosition());
+        m_streamPacket->put_S64(m_streamPacketTime.count());
         m_streamPacket->disablePayloadCheckSum();
     }
 
-    // request packet from queue
-    MsgPacket* p = nullptr;
+    // add pending packets of this viewer
+    while(!m_control.empty()) {
+        appendPacket(m_control.front());
+        m_control.pop_front();
+    }
 
-    while((p = m_queue->read()) != nullptr) {
+    if(isPaused()) {
+        return nullptr;
+    }
 
-        // add data
-        m_streamPacket->put_U16(p->getMsgID());
-        m_streamPacket->put_U16(p->getClientID());
+    // live viewers falling too far behind skip to the latest keyframe
+    if(!m_timeshift && m_maxLiveLag.count() > 0) {
+        int64_t skipped = queue->catchUp(m_cursor, m_maxLiveLag);
 
-        // add payload
-        uint8_t* data = p->getPayload();
-        int length = p->getPayloadLength();
-        m_streamPacket->put_Blob(data, length);
+        if(skipped > 0) {
+            MsgPacket* status = new MsgPacket(ROBOTV_STREAM_STATUS, ROBOTV_CHANNEL_STREAM);
+            status->put_U32(ROBOTV_STREAM_STATUS_CATCHUP);
+            status->put_U32((uint32_t)skipped);
+            appendPacket(status);
+        }
+    }
 
-        delete p;
+    bool records = sendRecords();
 
-        // send payload packet if it's big enough
-        if(m_streamPacket->getPayloadLength() >= MIN_PACKET_SIZE) {
-            MsgPacket* result = m_streamPacket;
-            m_streamPacket = nullptr;
-            return result;
+    // copy the packets from the queue straight into the payload packet.
+    // read just what's missing, so we don't read data twice.
+    auto append = [&](const LiveQueue::Record& r) {
+        if(records) {
+            m_streamPacket->put_Blob(r.payload - LiveQueue::Record::HeaderLength, LiveQueue::Record::HeaderLength + r.length);
+        }
+        else {
+            m_streamPacket->put_U16(r.msgId);
+            m_streamPacket->put_U16(r.clientId);
+            m_streamPacket->put_Blob(r.payload, r.length);
         }
-    }
 
-    if(m_queue->isPaused()) {
-        MsgPacket* result = m_streamPacket;
-        m_streamPacket = nullptr;
-        return result;
-    }
+        return (m_streamPacket->getPayloadLength() < MIN_PACKET_SIZE);
+    };
 
-    return nullptr;
-}
+    while(m_streamPacket->getPayloadLength() < MIN_PACKET_SIZE) {
+        size_t missing = MIN_PACKET_SIZE - m_streamPacket->getPayloadLength();
 
-void LiveStreamer::Receive(const uchar* packet, int length) {
-    putTsPacket((uint8_t*)packet, roboTV::currentTimeMillis().count());
-}
+        // the timeshift file holds the records in the wire layout, so they
+        // can be sent straight from the file. pushed packets take what's
+        // there once they are due.
+        if(records) {
+            bool due = m_push && roboTV::currentTimeMillis() - m_streamPacketTime >= std::chrono::milliseconds(PUSH_MAX_DELAY);
+            TimeShiftStorage::FileRange range;
 
-void LiveStreamer::processChannelChange(const cChannel* channel) {
-    if(roboTV::Hash::createChannelUid(channel) != m_uid) {
-        return;
-    }
+            if(queue->readRange(m_cursor, due ? 1 : missing, MAX_RANGE_SIZE, range)) {
+                if(range.length == 0) {
+                    return nullptr;
+                }
 
-    isyslog("ChannelChange()");
+                m_streamPacket->attachFile(range.owner, range.fd, range.offset, range.length);
+                break;
+            }
+        }
 
-    Detach();
-    cleanupQueue(); // remove pre-queued packets
-    switchChannel(channel);
-}
+        if(queue->readChunk(m_cursor, m_chunk, missing, append) == 0) {
+            return nullptr;
+        }
+    }
 
-void LiveStreamer::createDemuxers(StreamBundle* bundle) {
-    DemuxerBundle& demuxers = getDemuxers();
+    // send payload packet if it's big enough
+    aggregateAge += (roboTV::currentTimeMillis() - m_streamPacketTime).count();
+    aggregates++;
 
-    // update demuxers
-    demuxers.updateFrom(bundle);
+    MsgPacket* result = m_streamPacket;
+    m_streamPacket = nullptr;
+    return result;
+}
 
-    // update pids
-    SetPids(nullptr);
+void LiveStreamer::appendPacket(MsgPacket* p) {
+    uint8_t* data = p->getPayload();
+    int length = p->getPayloadLength();
 
-    for(auto i = demuxers.begin(); i != demuxers.end(); i++) {
-        TsDemuxer* dmx = *i;
-        AddPid(dmx->getPid());
+    // add header
+    if(sendRecords()) {
+        LiveQueue::Record::encode(m_streamPacket->reserve(LiveQueue::Record::HeaderLength), p->getMsgID(), p->getClientID(), length);
+    }
+    else {
+        m_streamPacket->put_U16(p->getMsgID());
+        m_streamPacket->put_U16(p->getClientID());
     }
-}
 
-int64_t LiveStreamer::seek(int64_t wallclockPositionMs) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    // add payload
+    m_streamPacket->put_Blob(data, length);
 
-    // remove pending packet
-    delete m_streamPacket;
-    m_streamPacket = nullptr;
+    delete p;
+}
 
-    // seek
-    return m_queue->seek(wallclockPositionMs);
+void LiveStreamer::setMaxLiveLag(int seconds) {
+    m_maxLiveLag = std::chrono::milliseconds(seconds * 1000);
+    isyslog("maximum live lag: %i seconds", seconds);
 }
 
-StreamBundle LiveStreamer::createFromChannel(const cChannel* channel) {
-    StreamBundle item;
-
-    // add video stream
-    int vpid = channel->Vpid();
-    int vtype = channel->Vtype();
-
-    item.addStream(StreamInfo(vpid,
-                              vtype == 0x02 ? StreamInfo::Type::MPEG2VIDEO :
-                              vtype == 0x1b ? StreamInfo::Type::H264 :
-                              vtype == 0x24 ? StreamInfo::Type::H265 :
-                              StreamInfo::Type::NONE));
-
-    // add (E)AC3 streams
-    for(int i = 0; channel->Dpid(i) != 0; i++) {
-        int dtype = channel->Dtype(i);
-        item.addStream(StreamInfo(channel->Dpid(i),
-                                  dtype == 0x6A ? StreamInfo::Type::AC3 :
-                                  dtype == 0x7A ? StreamInfo::Type::EAC3 :
-                                  StreamInfo::Type::NONE,
-                                  channel->Dlang(i)));
-    }
+bool LiveStreamer::sendRecords() {
+    // clients with protocol version 10 and above receive length-prefixed records
+    return (m_parent->protocolVersion() >= 10);
+}
 
-    // add audio streams
-    for(int i = 0; channel->Apid(i) != 0; i++) {
-        int atype = channel->Atype(i);
-        item.addStream(StreamInfo(channel->Apid(i),
-                                  atype == 0x04 ? StreamInfo::Type::MPEG2AUDIO :
-                                  atype == 0x03 ? StreamInfo::Type::MPEG2AUDIO :
-                                  atype == 0x0f ? StreamInfo::Type::AAC :
-                                  atype == 0x11 ? StreamInfo::Type::LATM :
-                                  StreamInfo::Type::NONE,
-                                  channel->Alang(i)));
+void LiveStreamer::processChannelChange(const cChannel* channel) {
+    if(m_channel) {
+        m_channel->processChannelChange(channel);
     }
+}
 
-    // add subtitle streams
-    for(int i = 0; channel->Spid(i) != 0; i++) {
-        StreamInfo stream(channel->Spid(i), StreamInfo::Type::DVBSUB, channel->Slang(i));
-
-        stream.setSubtitlingDescriptor(
-                channel->SubtitlingType(i),
-                channel->CompositionPageId(i),
-                channel->AncillaryPageId(i));
+int64_t LiveStreamer::seek(int64_t wallclockPositionMs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
 
-        item.addStream(stream);
+    if(!m_channel) {
+        return 0;
     }
 
-    return item;
-}
+    // remove pending packet
+    delete m_streamPacket;
+    m_streamPacket = nullptr;
 
-int64_t LiveStreamer::getCurrentTime(TsDemuxer::StreamPacket *p) {
-    return p->streamPosition;
-}
+    // seeking close to live continues live playback
+    m_timeshift = (roboTV::currentTimeMillis().count() - wallclockPositionMs > m_maxLiveLag.count());
 
-void LiveStreamer::onPacket(MsgPacket *p, StreamInfo::Content content, int64_t pts) {
-    m_queue->queue(p, content, pts);
+    // seek
+    return m_channel->queue()->seek(m_cursor, wallclockPositionMs);
 }
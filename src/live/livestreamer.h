@@ -27,63 +27,75 @@
 
 #include <stdint.h>
 #include <vdr/channels.h>
-#include <vdr/device.h>
-#include <vdr/receiver.h>
-#include <vdr/ringbuffer.h>
 
-#include "robotvdmx/demuxer.h"
-#include "robotvdmx/streambundle.h"
-#include "robotvdmx/demuxerbundle.h"
+#include "robotvdmx/streaminfo.h"
 #include "robotv/robotvcommand.h"
 #include "livequeue.h"
 
-#include <list>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
 #include <mutex>
-#include <robotv/StreamPacketProcessor.h>
+#include <vector>
 
 class cChannel;
 class MsgPacket;
-class LiveQueue;
+class LiveChannel;
 class RoboTvClient;
 
-class LiveStreamer : public cReceiver, protected StreamPacketProcessor {
+class LiveStreamer {
+    friend class LiveChannel;
+
 private:
 
     void sendStatus(int status);
 
-    LiveQueue* m_queue = NULL;
+    std::shared_ptr<LiveChannel> m_channel;
+
+    LiveQueue::Cursor m_cursor;
 
     RoboTvClient* m_parent = NULL;
 
+    int m_priority;
+
     std::string m_language;
 
     StreamInfo::Type m_langStreamType = StreamInfo::Type::AC3;
 
-    uint32_t m_uid;
+    std::atomic<bool> m_paused;
+
+    // the client paused or seeked (no catch-up with live)
+    std::atomic<bool> m_timeshift;
 
     std::mutex m_mutex;
 
     MsgPacket* m_streamPacket = NULL;
 
-protected:
+    std::vector<uint8_t> m_chunk;
 
-#if VDRVERSNUM < 20300
-    void Receive(uchar* data, int length);
-#else
-    void Receive(const uchar* Data, int Length);
-#endif
+    std::chrono::milliseconds m_streamPacketTime;
 
-    int64_t getCurrentTime(TsDemuxer::StreamPacket *p);
+    std::deque<MsgPacket*> m_control;
 
-    void onPacket(MsgPacket* p, StreamInfo::Content content, int64_t pts);
+    std::atomic<bool> m_push;
 
-    MsgPacket* createStreamChangePacket(DemuxerBundle& bundle);
+    // a pull request waits for new packets
+    std::atomic<bool> m_waiting;
 
-private:
+    std::atomic<uint32_t> m_credits;
+
+    std::mutex m_pushMutex;
+
+    static std::chrono::milliseconds m_maxLiveLag;
+
+    MsgPacket* aggregatePacket();
 
-    StreamBundle createFromChannel(const cChannel* channel);
+    void appendPacket(MsgPacket* p);
 
-    void createDemuxers(StreamBundle* bundle);
+    bool sendRecords();
+
+    void requestPush();
 
 public:
 
@@ -101,12 +113,50 @@ public:
 
     MsgPacket* requestPacket();
 
+    /**
+     * Notify the client about new packets in pull mode.
+     * Used while a request of the client waits for packets.
+     * @param on true to enable notifications
+     */
+    void setWaiting(bool on);
+
+    void enablePush(uint32_t credits);
+
+    void addCredits(uint32_t credits);
+
+    /**
+     * Push the available packets (client worker).
+     * Sends aggregates as long as the client has credits.
+     */
+    void pushPackets();
+
     void requestSignalInfo();
 
     int switchChannel(const cChannel* channel);
 
+    /**
+     * Detach the streamer from its client (connection lost).
+     * The channel and the timeshift position are kept until the
+     * streamer is attached to a client again or deleted.
+     */
+    void detach();
+
+    /**
+     * Attach a detached streamer to a (reconnected) client.
+     * @param parent client
+     * @param credits push mode credit window (0 = client pulls packets)
+     */
+    void attach(RoboTvClient* parent, uint32_t credits);
+
     int64_t seek(int64_t wallclockPositionMs);
 
+    /**
+     * Set the maximum lag of live viewers.
+     * Viewers falling further behind skip to the latest keyframe.
+     * @param seconds maximum lag (0 = disabled)
+     */
+    static void setMaxLiveLag(int seconds);
+
 };
 
 #endif  // ROBOTV_RECEIVER_H
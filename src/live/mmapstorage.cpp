@@ -0,0 +1,164 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <cstring>
+#include <algorithm>
+#include <vdr/tools.h>
+
+#include "mmapstorage.h"
+
+static off_t pageAlign(off_t position) {
+    static off_t pageSize = sysconf(_SC_PAGESIZE);
+    return position & ~(pageSize - 1);
+}
+
+MmapStorage::MmapStorage() : m_fd(-1), m_data(nullptr), m_size(0) {
+    m_writePosition = 0;
+}
+
+MmapStorage::~MmapStorage() {
+    close();
+}
+
+bool MmapStorage::open(const std::string& filename, off_t size) {
+    m_fd = ::open(filename.c_str(), O_CREAT | O_RDWR, 0644);
+
+    if(m_fd == -1) {
+        esyslog("unable to create timeshift file: %s", strerror(errno));
+        return false;
+    }
+
+    // the whole file must be backed by disk space, otherwise
+    // writing into the mapping could fail with SIGBUS
+    int rc = preallocate(m_fd, size);
+
+    if(rc != 0) {
+        esyslog("unable to pre-allocate %li bytes for timeshift ringbuffer: %s", size, strerror(rc));
+        close();
+        return false;
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+
+    if(data == MAP_FAILED) {
+        esyslog("unable to map timeshift ringbuffer: %s", strerror(errno));
+        close();
+        return false;
+    }
+
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    m_data = (uint8_t*)data;
+    m_size = size;
+    m_writePosition = 0;
+
+    return true;
+}
+
+void MmapStorage::close() {
+    if(m_data != nullptr) {
+        munmap(m_data, m_size);
+    }
+
+    if(m_fd != -1) {
+        ::close(m_fd);
+    }
+
+    m_data = nullptr;
+    m_fd = -1;
+}
+
+off_t MmapStorage::writePosition() {
+    return (m_data == nullptr) ? -1 : m_writePosition;
+}
+
+void MmapStorage::wrap() {
+    m_writePosition = 0;
+}
+
+bool MmapStorage::write(struct iovec* iov, int iovcnt) {
+    if(m_data == nullptr) {
+        return false;
+    }
+
+    size_t length = 0;
+
+    for(int i = 0; i < iovcnt; i++) {
+        length += iov[i].iov_len;
+    }
+
+    if(m_writePosition + (off_t)length > m_size) {
+        esyslog("timeshift ringbuffer overflow (%lu bytes)", length);
+        return false;
+    }
+
+    for(int i = 0; i < iovcnt; i++) {
+        memcpy(m_data + m_writePosition, iov[i].iov_base, iov[i].iov_len);
+        m_writePosition += iov[i].iov_len;
+    }
+
+    return true;
+}
+
+size_t MmapStorage::readData(off_t position, uint8_t* buffer, size_t length) {
+    if(m_data == nullptr || position < 0 || position >= m_size) {
+        return 0;
+    }
+
+    // the writer may modify the mapping concurrently. the queue
+    // drops data that has been overwritten while copying.
+    length = std::min(length, (size_t)(m_size - position));
+    memcpy(buffer, m_data + position, length);
+
+    return length;
+}
+
+bool MmapStorage::writeAt(off_t position, const uint8_t* data, size_t length) {
+    if(m_data == nullptr || position < 0 || position + (off_t)length > m_size) {
+        return false;
+    }
+
+    memcpy(m_data + position, data, length);
+    return true;
+}
+
+void MmapStorage::writeBack(off_t start, off_t end) {
+    flush(start, std::min(end, m_size));
+}
+
+void MmapStorage::flush(off_t start, off_t end) {
+    if(m_data == nullptr || end <= start) {
+        return;
+    }
+
+    start = pageAlign(start);
+
+    if(msync(m_data + start, end - start, MS_SYNC) != 0) {
+        esyslog("Failed to sync timeshift ring-buffer !");
+    }
+}
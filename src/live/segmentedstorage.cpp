@@ -0,0 +1,262 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <vdr/tools.h>
+
+#include "tools/time.h"
+#include "segmentedstorage.h"
+#include "filestorage.h"
+#include "timeshiftpool.h"
+
+// room for the packets written after a segment is full
+#define SEGMENT_HEADROOM (1024 * 1024)
+
+SegmentedStorage::SegmentedStorage(const std::string& backend, off_t segmentSize) :
+    m_backend(backend),
+    m_segmentSize(segmentSize) {
+}
+
+SegmentedStorage::~SegmentedStorage() {
+    close();
+}
+
+bool SegmentedStorage::open(const std::string& filename, off_t size) {
+    // the file size is given by the segment size
+    m_fileName = filename;
+
+    return addSegment(0);
+}
+
+void SegmentedStorage::close() {
+    std::deque<Segment> segments;
+
+    {
+        std::lock_guard<std::mutex> lock(m_segmentMutex);
+        segments.swap(m_segments);
+    }
+}
+
+off_t SegmentedStorage::writePosition() {
+    return m_segments.empty() ? -1 : m_segments.back().end;
+}
+
+void SegmentedStorage::wrap() {
+    if(m_segments.empty()) {
+        return;
+    }
+
+    if(!addSegment(m_segments.back().end)) {
+        esyslog("unable to add timeshift segment - continuing in the current segment");
+    }
+}
+
+bool SegmentedStorage::write(struct iovec* iov, int iovcnt) {
+    if(m_segments.empty()) {
+        return false;
+    }
+
+    // the backend may modify the buffers
+    size_t length = 0;
+
+    for(int i = 0; i < iovcnt; i++) {
+        length += iov[i].iov_len;
+    }
+
+    auto& s = m_segments.back();
+
+    if(!s.storage->write(iov, iovcnt)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_segmentMutex);
+
+    s.end += length;
+    s.lastWrite = roboTV::currentTimeMillis();
+
+    return true;
+}
+
+size_t SegmentedStorage::readData(off_t position, uint8_t* buffer, size_t length) {
+    std::shared_ptr<TimeShiftStorage> storage;
+    off_t start;
+
+    {
+        std::lock_guard<std::mutex> lock(m_segmentMutex);
+        Segment* s = findSegment(position);
+
+        if(s == nullptr) {
+            return 0;
+        }
+
+        // packets never cross segments
+        length = std::min(length, (size_t)(s->end - position));
+        storage = s->storage;
+        start = s->start;
+    }
+
+    return storage->readData(position - start, buffer, length);
+}
+
+bool SegmentedStorage::fileRange(off_t position, size_t length, FileRange& range) {
+    std::lock_guard<std::mutex> lock(m_segmentMutex);
+    Segment* s = findSegment(position);
+
+    if(s == nullptr) {
+        return false;
+    }
+
+    int fd = s->storage->fileDescriptor();
+
+    if(fd == -1) {
+        return false;
+    }
+
+    // the segment stays open until the range has been sent
+    range.owner = s->storage;
+    range.fd = fd;
+    range.offset = position - s->start;
+    range.length = std::min(length, (size_t)(s->end - position));
+
+    return true;
+}
+
+bool SegmentedStorage::writeAt(off_t position, const uint8_t* data, size_t length) {
+    Segment* s = findSegment(position);
+
+    if(s == nullptr) {
+        return false;
+    }
+
+    return s->storage->writeAt(position - s->start, data, length);
+}
+
+void SegmentedStorage::writeBack(off_t start, off_t end) {
+    std::vector<Segment> segments;
+
+    {
+        std::lock_guard<std::mutex> lock(m_segmentMutex);
+
+        for(auto& s : m_segments) {
+            if(s.start < end && s.end > start) {
+                segments.push_back(s);
+            }
+        }
+    }
+
+    for(auto& s : segments) {
+        s.storage->writeBack(std::max(start, s.start) - s.start, std::min(end, s.end) - s.start);
+    }
+}
+
+bool SegmentedStorage::segmentFull(off_t position) {
+    return !m_segments.empty() && (position - m_segments.back().start >= m_segmentSize);
+}
+
+off_t SegmentedStorage::startPosition() {
+    return m_segments.empty() ? 0 : m_segments.front().start;
+}
+
+void SegmentedStorage::retain(off_t maxSize, std::chrono::milliseconds maxAge) {
+    auto now = roboTV::currentTimeMillis();
+    std::deque<Segment> released;
+
+    std::lock_guard<std::mutex> lock(m_segmentMutex);
+
+    while(m_segments.size() > 1) {
+        auto& s = m_segments.front();
+
+        bool tooLarge = (m_segments.back().end - s.start > maxSize);
+        bool expired = (maxAge.count() > 0 && now - s.lastWrite > maxAge);
+
+        if(!tooLarge && !expired) {
+            break;
+        }
+
+        // closed with the last reference
+        released.push_back(s);
+        m_segments.pop_front();
+    }
+}
+
+bool SegmentedStorage::addSegment(off_t start) {
+    off_t size = m_segmentSize + SEGMENT_HEADROOM;
+
+    // the first segment uses the file of the queue
+    std::string fileName = m_segments.empty() ? m_fileName : TimeShiftPool::instance().acquire(size);
+    TimeShiftStorage* storage = TimeShiftStorage::create(m_backend);
+
+    if(!storage->open(fileName, size)) {
+        bool success = false;
+
+        // fall back to plain file storage
+        if(strcmp(storage->name(), "file") != 0) {
+            esyslog("%s storage failed - falling back to file storage", storage->name());
+            delete storage;
+            storage = new FileStorage();
+            success = storage->open(fileName, size);
+        }
+
+        if(!success) {
+            delete storage;
+
+            if(fileName != m_fileName) {
+                TimeShiftPool::instance().release(fileName);
+            }
+
+            return false;
+        }
+    }
+
+    // the segment is returned to the pool after the last reader is done
+    std::shared_ptr<TimeShiftStorage> segment(storage, [fileName](TimeShiftStorage* storage) {
+        storage->close();
+        delete storage;
+
+        TimeShiftPool::instance().release(fileName);
+    });
+
+    std::lock_guard<std::mutex> lock(m_segmentMutex);
+    m_segments.push_back({ start, start, roboTV::currentTimeMillis(), fileName, segment });
+
+    dsyslog("timeshift segment %s at %li (%s storage)", fileName.c_str(), start, storage->name());
+    return true;
+}
+
+SegmentedStorage::Segment* SegmentedStorage::findSegment(off_t position) {
+    // last segment starting at or before the position
+    auto i = std::upper_bound(m_segments.begin(), m_segments.end(), position, [](off_t p, const Segment& s) {
+        return p < s.start;
+    });
+
+    if(i == m_segments.begin()) {
+        return nullptr;
+    }
+
+    --i;
+    return (position < i->end) ? &*i : nullptr;
+}
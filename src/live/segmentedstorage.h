@@ -0,0 +1,121 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_SEGMENTEDSTORAGE_H
+#define ROBOTV_SEGMENTEDSTORAGE_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include "timeshiftstorage.h"
+
+/**
+ * Timeshift storage made of fixed-size segment files.
+ * The storage grows by adding segments and releases the oldest segments
+ * as a whole, so it never wraps. Positions are contiguous and increase
+ * monotonically. Every segment is stored by its own backend instance.
+ * Readers hold a reference to the segment they read, so a segment
+ * released by the writer is closed after the last read finished.
+ */
+class SegmentedStorage : public TimeShiftStorage {
+public:
+
+    /**
+     * Create segmented storage.
+     * @param backend name of the backend storing the segments
+     * @param segmentSize size of a segment
+     */
+    SegmentedStorage(const std::string& backend, off_t segmentSize);
+
+    virtual ~SegmentedStorage();
+
+    bool open(const std::string& filename, off_t size);
+
+    void close();
+
+    off_t writePosition();
+
+    /**
+     * Start a new segment (the write position doesn't change).
+     */
+    void wrap();
+
+    bool write(struct iovec* iov, int iovcnt);
+
+    size_t readData(off_t position, uint8_t* buffer, size_t length);
+
+    /**
+     * Segments are never overwritten while they are referenced,
+     * so ranges within a segment can be sent from the segment file.
+     */
+    bool fileRange(off_t position, size_t length, FileRange& range);
+
+    bool writeAt(off_t position, const uint8_t* data, size_t length);
+
+    void writeBack(off_t start, off_t end);
+
+    bool segmented() const {
+        return true;
+    }
+
+    bool segmentFull(off_t position);
+
+    off_t startPosition();
+
+    void retain(off_t maxSize, std::chrono::milliseconds maxAge);
+
+    const char* name() const {
+        return "segmented";
+    }
+
+private:
+
+    struct Segment {
+        off_t start;
+        off_t end;
+        std::chrono::milliseconds lastWrite;
+        std::string fileName;
+        std::shared_ptr<TimeShiftStorage> storage;
+    };
+
+    bool addSegment(off_t start);
+
+    Segment* findSegment(off_t position);
+
+    std::deque<Segment> m_segments;
+
+    // protects the segment list against the readers
+    // (only the writer modifies the list)
+    std::mutex m_segmentMutex;
+
+    std::string m_backend;
+
+    std::string m_fileName;
+
+    off_t m_segmentSize;
+
+};
+
+#endif // ROBOTV_SEGMENTEDSTORAGE_H
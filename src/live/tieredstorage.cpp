@@ -0,0 +1,352 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cstring>
+#include <algorithm>
+#include <vdr/tools.h>
+
+#include "tools/statistics.h"
+#include "tieredstorage.h"
+#include "timeshiftrecord.h"
+#include "filestorage.h"
+
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+// maximum number of bytes spilled to disk at once
+#define SPILL_SIZE (1024 * 1024)
+
+// additional RAM if the whole buffer fits into memory
+#define RAM_HEADROOM (4 * 1024 * 1024)
+
+TieredStorage::TieredStorage(TimeShiftStorage* disk, size_t ramSize, bool hugePages) :
+    m_disk(disk),
+    m_diskOpen(false),
+    m_diskFailed(false),
+    m_ramOnly(false),
+    m_size(0),
+    m_ram(nullptr),
+    m_ramSize(ramSize),
+    m_ramHead(0),
+    m_hugePages(hugePages),
+    m_writePosition(0) {
+}
+
+TieredStorage::~TieredStorage() {
+    close();
+    delete m_disk;
+}
+
+bool TieredStorage::open(const std::string& filename, off_t size) {
+    m_fileName = filename;
+    m_size = size;
+
+    // the whole buffer fits into memory - the disk will never be used
+    if(m_ramSize >= (size_t)size) {
+        m_ramOnly = true;
+        m_ramSize = size + RAM_HEADROOM;
+    }
+
+    m_ramHead = 0;
+    m_writePosition = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_extentMutex);
+        m_extents.clear();
+    }
+
+    return allocateRam();
+}
+
+bool TieredStorage::allocateRam() {
+    size_t size = (m_ramSize + HUGEPAGE_SIZE - 1) & ~((size_t)HUGEPAGE_SIZE - 1);
+    void* data = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if(m_hugePages) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if(data == MAP_FAILED) {
+            isyslog("no huge pages available for the timeshift RAM tier: %s", strerror(errno));
+        }
+    }
+#endif
+
+    if(data == MAP_FAILED) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if(data == MAP_FAILED) {
+            esyslog("unable to allocate %lu bytes for the timeshift RAM tier: %s", size, strerror(errno));
+            return false;
+        }
+
+#ifdef MADV_HUGEPAGE
+        if(m_hugePages) {
+            madvise(data, size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    m_ram = (uint8_t*)data;
+    m_ramSize = size;
+
+    isyslog("timeshift RAM tier: %lu bytes%s", m_ramSize, m_ramOnly ? " (no disk)" : "");
+    return true;
+}
+
+bool TieredStorage::openDisk() {
+    if(m_diskOpen) {
+        return true;
+    }
+
+    if(m_diskFailed) {
+        return false;
+    }
+
+    isyslog("timeshift RAM tier full - spilling to %s", m_fileName.c_str());
+
+    if(m_disk->open(m_fileName, m_size)) {
+        m_diskOpen = true;
+        return true;
+    }
+
+    // fall back to plain file storage
+    if(strcmp(m_disk->name(), "file") != 0) {
+        esyslog("%s storage failed - falling back to file storage", m_disk->name());
+        delete m_disk;
+        m_disk = new FileStorage();
+
+        if(m_disk->open(m_fileName, m_size)) {
+            m_diskOpen = true;
+            return true;
+        }
+    }
+
+    esyslog("Failed to create timeshift ringbuffer !");
+    m_diskFailed = true;
+    return false;
+}
+
+void TieredStorage::close() {
+    if(m_ram != nullptr) {
+        munmap(m_ram, m_ramSize);
+    }
+
+    if(m_diskOpen) {
+        m_disk->close();
+    }
+
+    m_ram = nullptr;
+    m_diskOpen = false;
+
+    std::lock_guard<std::mutex> lock(m_extentMutex);
+    m_extents.clear();
+}
+
+off_t TieredStorage::writePosition() {
+    return (m_ram == nullptr) ? -1 : m_writePosition;
+}
+
+void TieredStorage::wrap() {
+    m_writePosition = 0;
+}
+
+bool TieredStorage::write(struct iovec* iov, int iovcnt) {
+    for(int i = 0; i < iovcnt; i++) {
+        if(!writeAt(m_writePosition, (const uint8_t*)iov[i].iov_base, iov[i].iov_len)) {
+            return false;
+        }
+
+        m_writePosition += iov[i].iov_len;
+    }
+
+    return true;
+}
+
+size_t TieredStorage::readData(off_t position, uint8_t* buffer, size_t length) {
+    size_t done = 0;
+
+    // records may span several extents
+    while(done < length) {
+        size_t count = readExtent(position + done, buffer + done, length - done);
+
+        if(count == 0) {
+            break;
+        }
+
+        done += count;
+    }
+
+    return done;
+}
+
+size_t TieredStorage::readExtent(off_t position, uint8_t* buffer, size_t length) {
+    static auto& ramReads = roboTV::Statistics::instance().counter("timeshift.ram.reads");
+    static auto& diskReads = roboTV::Statistics::instance().counter("timeshift.disk.reads");
+
+    if(m_ram == nullptr) {
+        return 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_extentMutex);
+
+        // newer data replaces older data at the same position
+        for(auto i = m_extents.rbegin(); i != m_extents.rend(); i++) {
+            if(position >= i->position && position < i->position + (off_t)i->length) {
+                size_t delta = position - i->position;
+                length = std::min(length, i->length - delta);
+                memcpy(buffer, m_ram + i->offset + delta, length);
+                ramReads++;
+                return length;
+            }
+        }
+
+        // stop in front of data that hasn't been spilled yet
+        for(auto& e : m_extents) {
+            if(e.position > position) {
+                length = std::min(length, (size_t)(e.position - position));
+            }
+        }
+    }
+
+    if(!m_diskOpen) {
+        return 0;
+    }
+
+    diskReads++;
+    return m_disk->readData(position, buffer, length);
+}
+
+bool TieredStorage::writeAt(off_t position, const uint8_t* data, size_t length) {
+    if(m_ram == nullptr) {
+        return false;
+    }
+
+    // way too big for the RAM tier
+    if(length > m_ramSize / 4) {
+        return spill(position, data, length);
+    }
+
+    // the reserved space isn't visible to the readers
+    uint8_t* buffer = reserve(length);
+    memcpy(buffer, data, length);
+
+    size_t offset = buffer - m_ram;
+    m_ramHead = offset + length;
+
+    std::lock_guard<std::mutex> lock(m_extentMutex);
+
+    // append to the current extent if possible
+    if(!m_extents.empty()) {
+        Extent& last = m_extents.back();
+
+        if(last.position + (off_t)last.length == position && last.offset + last.length == offset) {
+            last.length += length;
+            return true;
+        }
+    }
+
+    m_extents.push_back({position, offset, length});
+    return true;
+}
+
+uint8_t* TieredStorage::reserve(size_t length) {
+    for(;;) {
+        if(m_extents.empty()) {
+            return m_ram;
+        }
+
+        size_t tail = m_extents.front().offset;
+
+        // free space at the end and at the start of the ring
+        if(m_ramHead >= tail) {
+            if(m_ramSize - m_ramHead >= length) {
+                return m_ram + m_ramHead;
+            }
+
+            if(tail > length) {
+                return m_ram;
+            }
+        }
+
+        // free space in between
+        else if(tail - m_ramHead > length) {
+            return m_ram + m_ramHead;
+        }
+
+        evict();
+    }
+}
+
+void TieredStorage::evict() {
+    static auto& spilled = roboTV::Statistics::instance().counter("timeshift.spill.bytes");
+
+    Extent& e = m_extents.front();
+    size_t length = 0;
+
+    // evict complete records if possible. header and payload are
+    // written separately, so a record may be split across extents.
+    while(length + TimeShiftRecord::HeaderLength <= e.length && length < SPILL_SIZE) {
+        length += TimeShiftRecord::HeaderLength + TimeShiftRecord::decode(m_ram + e.offset + length).length;
+    }
+
+    if(length == 0 || length > e.length) {
+        length = e.length;
+    }
+
+    // only this thread modifies the RAM ring, so the data can be
+    // written without holding the lock
+    if(!m_ramOnly) {
+        spill(e.position, m_ram + e.offset, length);
+        spilled += length;
+    }
+
+    std::lock_guard<std::mutex> lock(m_extentMutex);
+
+    e.position += length;
+    e.offset += length;
+    e.length -= length;
+
+    if(e.length == 0) {
+        m_extents.pop_front();
+    }
+}
+
+bool TieredStorage::spill(off_t position, const uint8_t* data, size_t length) {
+    if(!openDisk()) {
+        return false;
+    }
+
+    return m_disk->writeAt(position, data, length);
+}
+
+void TieredStorage::writeBack(off_t start, off_t end) {
+    // data still in the RAM tier doesn't need to be written
+    if(m_diskOpen) {
+        m_disk->writeBack(start, end);
+    }
+}
@@ -0,0 +1,133 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_TIEREDSTORAGE_H
+#define ROBOTV_TIEREDSTORAGE_H
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include "timeshiftstorage.h"
+
+/**
+ * Timeshift storage with a RAM tier in front of a disk backend.
+ * New packets are written into a RAM ring. Once the ring overflows, the
+ * oldest packets are spilled to the disk backend at their position. The
+ * disk backend is not created before the first spill, so short pauses
+ * don't cause any disk I/O. Reads are served from the tier holding the
+ * position. Readers only lock the extent list, never the disk writes.
+ */
+class TieredStorage : public TimeShiftStorage {
+public:
+
+    /**
+     * Create tiered storage.
+     * @param disk disk backend (ownership is transferred)
+     * @param ramSize size of the RAM ring
+     * @param hugePages back the RAM ring by huge pages
+     */
+    TieredStorage(TimeShiftStorage* disk, size_t ramSize, bool hugePages);
+
+    virtual ~TieredStorage();
+
+    bool open(const std::string& filename, off_t size);
+
+    void close();
+
+    off_t writePosition();
+
+    void wrap();
+
+    bool write(struct iovec* iov, int iovcnt);
+
+    size_t readData(off_t position, uint8_t* buffer, size_t length);
+
+    bool writeAt(off_t position, const uint8_t* data, size_t length);
+
+    void writeBack(off_t start, off_t end);
+
+    bool resizable() const {
+        return !m_ramOnly && m_disk->resizable();
+    }
+
+    const char* name() const {
+        return "ram";
+    }
+
+private:
+
+    /**
+     * Contiguous area of the RAM ring holding consecutive packets.
+     */
+    struct Extent {
+        off_t position;
+        size_t offset;
+        size_t length;
+    };
+
+    bool allocateRam();
+
+    bool openDisk();
+
+    uint8_t* reserve(size_t length);
+
+    void evict();
+
+    bool spill(off_t position, const uint8_t* data, size_t length);
+
+    /**
+     * Read from a single extent or from the disk up to the next extent.
+     */
+    size_t readExtent(off_t position, uint8_t* buffer, size_t length);
+
+    TimeShiftStorage* m_disk;
+
+    std::atomic<bool> m_diskOpen;
+
+    bool m_diskFailed;
+
+    bool m_ramOnly;
+
+    std::string m_fileName;
+
+    off_t m_size;
+
+    uint8_t* m_ram;
+
+    size_t m_ramSize;
+
+    size_t m_ramHead;
+
+    bool m_hugePages;
+
+    std::deque<Extent> m_extents;
+
+    std::mutex m_extentMutex;
+
+    off_t m_writePosition;
+
+};
+
+#endif // ROBOTV_TIEREDSTORAGE_H
@@ -0,0 +1,70 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include "timeshiftindex.h"
+#include <algorithm>
+
+void TimeShiftIndex::add(off_t position, int wrapCount, int64_t wallclockTime, int64_t pts) {
+    m_entries.push_back({position, wallclockTime, pts, wrapCount});
+}
+
+bool TimeShiftIndex::trim(off_t writePosition, int wrapCount) {
+    // entries of the previous cycle behind the writer (and all older
+    // cycles) have been overwritten. these form a prefix of the index.
+    auto i = std::lower_bound(m_entries.begin(), m_entries.end(), wrapCount - 1, [&](const Entry& e, int cycle) {
+        return (e.wrapCount < cycle) || (e.wrapCount == cycle && e.position < writePosition);
+    });
+
+    if(i == m_entries.begin()) {
+        return false;
+    }
+
+    m_entries.erase(m_entries.begin(), i);
+    return true;
+}
+
+void TimeShiftIndex::clear() {
+    m_entries.clear();
+}
+
+const TimeShiftIndex::Entry* TimeShiftIndex::findByTime(int64_t wallclockTime) const {
+    if(m_entries.empty()) {
+        return nullptr;
+    }
+
+    auto i = std::upper_bound(m_entries.begin(), m_entries.end(), wallclockTime, [](int64_t t, const Entry& e) {
+        return t < e.wallclockTime;
+    });
+
+    return (i == m_entries.begin()) ? &*i : &*(i - 1);
+}
+
+const TimeShiftIndex::Entry* TimeShiftIndex::findByPosition(off_t position, int wrapCount) const {
+    auto i = std::upper_bound(m_entries.begin(), m_entries.end(), wrapCount, [&](int cycle, const Entry& e) {
+        return (cycle < e.wrapCount) || (cycle == e.wrapCount && position < e.position);
+    });
+
+    return (i == m_entries.begin()) ? nullptr : &*(i - 1);
+}
@@ -0,0 +1,96 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_TIMESHIFTINDEX_H
+#define ROBOTV_TIMESHIFTINDEX_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <deque>
+
+/**
+ * Seek index of the timeshift ringbuffer.
+ * Entries are appended in write order, so they are sorted by their
+ * storage location and wallclock time. Lookups by these keys are
+ * binary searches.
+ */
+class TimeShiftIndex {
+public:
+
+    struct Entry {
+        off_t position;
+        int64_t wallclockTime;
+        int64_t pts;
+        int wrapCount;
+    };
+
+    void add(off_t position, int wrapCount, int64_t wallclockTime, int64_t pts);
+
+    /**
+     * Remove all entries overwritten by the writer.
+     * @param writePosition current write position
+     * @param wrapCount current write cycle
+     * @return true if entries have been removed
+     */
+    bool trim(off_t writePosition, int wrapCount);
+
+    void clear();
+
+    bool empty() const {
+        return m_entries.empty();
+    }
+
+    size_t size() const {
+        return m_entries.size();
+    }
+
+    const Entry& front() const {
+        return m_entries.front();
+    }
+
+    const Entry& back() const {
+        return m_entries.back();
+    }
+
+    /**
+     * Find the last sync point at or before the given wallclock time.
+     * Times outside of the index are clamped to the first or last entry.
+     * @return entry or NULL if the index is empty
+     */
+    const Entry* findByTime(int64_t wallclockTime) const;
+
+    /**
+     * Find the last sync point at or before the given storage location.
+     * @return entry or NULL if there is no such entry
+     */
+    const Entry* findByPosition(off_t position, int wrapCount) const;
+
+private:
+
+    std::deque<Entry> m_entries;
+
+};
+
+#endif // ROBOTV_TIMESHIFTINDEX_H
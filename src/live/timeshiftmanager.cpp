@@ -0,0 +1,181 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <sys/statvfs.h>
+#include <algorithm>
+#include <vdr/tools.h>
+
+#include "timeshiftmanager.h"
+#include "timeshiftpool.h"
+#include "tools/json.hpp"
+
+// smallest buffer handed out, even if the disk is full
+#define MIN_SHARE (16 * 1024 * 1024)
+
+TimeShiftManager::TimeShiftManager() : m_budget(0), m_reserve(1024 * 1024 * 1024) {
+}
+
+TimeShiftManager& TimeShiftManager::instance() {
+    static TimeShiftManager manager;
+    return manager;
+}
+
+void TimeShiftManager::setBudget(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = bytes;
+    isyslog("timeshift budget: %lu bytes", m_budget);
+}
+
+void TimeShiftManager::setReserve(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_reserve = bytes;
+    isyslog("timeshift disk reserve: %lu bytes", m_reserve);
+}
+
+uint64_t TimeShiftManager::attach(int id, const std::string& directory, uint64_t maxSize) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Allocation& a = m_allocations[id];
+    a.directory = directory;
+    a.maxSize = maxSize;
+    a.size = 0;
+    a.viewers = 1;
+
+    // viewers joined before the buffer has been created
+    auto i = m_pendingViewers.find(id);
+
+    if(i != m_pendingViewers.end()) {
+        a.viewers = i->second;
+        m_pendingViewers.erase(i);
+    }
+
+    a.size = calculateShare(a);
+    isyslog("timeshift buffer %i: %lu bytes", id, a.size);
+
+    return a.size;
+}
+
+void TimeShiftManager::detach(int id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_allocations.erase(id);
+    m_pendingViewers.erase(id);
+}
+
+void TimeShiftManager::setViewers(int id, int viewers) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto i = m_allocations.find(id);
+
+    if(i == m_allocations.end()) {
+        m_pendingViewers[id] = viewers;
+        return;
+    }
+
+    i->second.viewers = viewers;
+}
+
+uint64_t TimeShiftManager::share(int id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto i = m_allocations.find(id);
+
+    if(i == m_allocations.end()) {
+        return 0;
+    }
+
+    Allocation& a = i->second;
+    uint64_t size = calculateShare(a);
+
+    if(size != a.size) {
+        isyslog("timeshift buffer %i: %lu -> %lu bytes", id, a.size, size);
+        a.size = size;
+    }
+
+    return a.size;
+}
+
+uint64_t TimeShiftManager::calculateShare(const Allocation& a) {
+    uint64_t weight = 0;
+
+    for(auto& i : m_allocations) {
+        weight += std::max(i.second.viewers, 1);
+    }
+
+    uint64_t total = available(a.directory);
+    uint64_t size = (total / weight) * std::max(a.viewers, 1);
+
+    size = std::max(size, (uint64_t)MIN_SHARE);
+    return std::min(size, a.maxSize);
+}
+
+uint64_t TimeShiftManager::available(const std::string& directory) {
+    // our own buffers are part of the usable space
+    uint64_t allocated = 0;
+
+    for(auto& i : m_allocations) {
+        allocated += i.second.size;
+    }
+
+    uint64_t total = UINT64_MAX;
+    struct statvfs fs;
+
+    if(statvfs(directory.c_str(), &fs) == 0) {
+        uint64_t space = (uint64_t)fs.f_bavail * fs.f_frsize + allocated;
+        total = (space > m_reserve) ? space - m_reserve : 0;
+    }
+
+    // the spare files of the pool are part of the budget
+    if(m_budget > 0) {
+        uint64_t spares = TimeShiftPool::instance().spareSize();
+        total = std::min(total, (m_budget > spares) ? m_budget - spares : 0);
+    }
+
+    return total;
+}
+
+std::string TimeShiftManager::report() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    nlohmann::json buffers = nlohmann::json::array();
+    uint64_t allocated = 0;
+
+    for(auto& i : m_allocations) {
+        buffers.push_back({
+            { "id", i.first },
+            { "size", i.second.size },
+            { "maxSize", i.second.maxSize },
+            { "viewers", i.second.viewers }
+        });
+
+        allocated += i.second.size;
+    }
+
+    nlohmann::json result = {
+        { "budget", m_budget },
+        { "reserve", m_reserve },
+        { "allocated", allocated },
+        { "spares", TimeShiftPool::instance().spareSize() },
+        { "buffers", buffers }
+    };
+
+    return result.dump();
+}
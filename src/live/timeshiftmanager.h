@@ -0,0 +1,119 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_TIMESHIFTMANAGER_H
+#define ROBOTV_TIMESHIFTMANAGER_H
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * Global disk budget of the timeshift buffers.
+ * Every timeshift buffer gets a share of the budget weighted by the
+ * number of its viewers. The budget is limited by the free space of the
+ * timeshift filesystem, so timeshifting doesn't fill up the disk used
+ * for recordings. Buffers query their share regularly and grow or
+ * shrink accordingly.
+ */
+class TimeShiftManager {
+public:
+
+    static TimeShiftManager& instance();
+
+    /**
+     * Set the total size of all timeshift buffers.
+     * @param bytes budget in bytes (0 = unlimited)
+     */
+    void setBudget(uint64_t bytes);
+
+    /**
+     * Set the amount of disk space to keep free.
+     * @param bytes reserve in bytes
+     */
+    void setReserve(uint64_t bytes);
+
+    /**
+     * Register a timeshift buffer.
+     * @param id id of the buffer
+     * @param directory directory of the buffer file
+     * @param maxSize maximum size of the buffer
+     * @return initial size of the buffer
+     */
+    uint64_t attach(int id, const std::string& directory, uint64_t maxSize);
+
+    void detach(int id);
+
+    /**
+     * Set the number of viewers of a buffer.
+     * The count of a buffer that isn't attached yet is kept until it attaches.
+     * @param id id of the buffer
+     * @param viewers number of viewers
+     */
+    void setViewers(int id, int viewers);
+
+    /**
+     * Get the current size of a buffer.
+     * @param id id of the buffer
+     * @return size of the buffer in bytes
+     */
+    uint64_t share(int id);
+
+    /**
+     * Report the budget and all allocations.
+     * @return report in JSON format
+     */
+    std::string report();
+
+private:
+
+    TimeShiftManager();
+
+    struct Allocation {
+        std::string directory;
+        uint64_t maxSize;
+        uint64_t size;
+        int viewers;
+    };
+
+    uint64_t calculateShare(const Allocation& a);
+
+    uint64_t available(const std::string& directory);
+
+    std::map<int, Allocation> m_allocations;
+
+    // viewers of buffers without an allocation yet
+    std::map<int, int> m_pendingViewers;
+
+    std::mutex m_mutex;
+
+    uint64_t m_budget;
+
+    uint64_t m_reserve;
+
+};
+
+#endif // ROBOTV_TIMESHIFTMANAGER_H
@@ -0,0 +1,239 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <vdr/tools.h>
+
+#include "timeshiftpool.h"
+#include "timeshiftstorage.h"
+
+#define FILE_PREFIX "robotv-ringbuffer-"
+#define POOL_PREFIX FILE_PREFIX "pool-"
+
+TimeShiftPool::TimeShiftPool() : m_fileSize(0), m_size(2), m_nextIndex(0), m_running(false), m_thread(nullptr) {
+}
+
+TimeShiftPool& TimeShiftPool::instance() {
+    static TimeShiftPool pool;
+    return pool;
+}
+
+void TimeShiftPool::setSize(int count) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_size = count;
+    isyslog("timeshift file pool: %i files", m_size);
+}
+
+void TimeShiftPool::start(const std::string& directory, off_t fileSize) {
+    if(m_thread != nullptr) {
+        return;
+    }
+
+    m_directory = directory;
+    m_fileSize = fileSize;
+
+    scan();
+
+    m_running = true;
+    m_thread = new std::thread([&]() {
+        fill();
+    });
+}
+
+void TimeShiftPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+
+    m_cond.notify_all();
+
+    if(m_thread != nullptr) {
+        m_thread->join();
+    }
+
+    delete m_thread;
+    m_thread = nullptr;
+}
+
+void TimeShiftPool::scan() {
+    DIR* dir = opendir(m_directory.c_str());
+
+    if(dir == nullptr) {
+        return;
+    }
+
+    struct dirent* entry = nullptr;
+    std::deque<std::string> files;
+
+    while((entry = readdir(dir)) != nullptr) {
+        if(strncmp(entry->d_name, FILE_PREFIX, strlen(FILE_PREFIX)) != 0) {
+            continue;
+        }
+
+        int index = 0;
+
+        if(sscanf(entry->d_name, POOL_PREFIX "%d", &index) == 1 && index >= m_nextIndex) {
+            m_nextIndex = index + 1;
+        }
+
+        files.push_back(entry->d_name);
+    }
+
+    closedir(dir);
+
+    for(auto& name : files) {
+        std::string filename = *AddDirectory(m_directory.c_str(), name.c_str());
+
+        // keep files of the previous run. they get a new name, so
+        // they can't clash with the files created from now on.
+        if((int)m_recycled.size() < m_size) {
+            std::string recycled = createFileName();
+
+            if(rename(filename.c_str(), recycled.c_str()) == 0) {
+                m_recycled.push_back(recycled);
+                continue;
+            }
+
+            esyslog("unable to rename timeshift file %s: %s", name.c_str(), strerror(errno));
+        }
+
+        isyslog("Removing old time-shift storage: %s", name.c_str());
+        unlink(filename.c_str());
+    }
+}
+
+std::string TimeShiftPool::acquire(off_t size) {
+    std::string filename;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if(m_ready.empty()) {
+            if(m_size > 0) {
+                isyslog("timeshift file pool exhausted");
+            }
+
+            return createFileName();
+        }
+
+        filename = m_ready.front();
+        m_ready.pop_front();
+    }
+
+    // allocate a replacement
+    m_cond.notify_all();
+
+    // spare files are sized for the largest buffer, keep just our share
+    if(size < m_fileSize && truncate(filename.c_str(), size) == -1) {
+        esyslog("unable to truncate timeshift file %s: %s", filename.c_str(), strerror(errno));
+    }
+
+    return filename;
+}
+
+void TimeShiftPool::release(const std::string& filename) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // the file may have been truncated - check it in the background
+        if(m_running && (int)(m_ready.size() + m_recycled.size()) < m_size) {
+            m_recycled.push_back(filename);
+            m_cond.notify_all();
+            return;
+        }
+    }
+
+    unlink(filename.c_str());
+}
+
+uint64_t TimeShiftPool::spareSize() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (m_ready.size() + m_recycled.size()) * (uint64_t)m_fileSize;
+}
+
+void TimeShiftPool::fill() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while(m_running) {
+        if(m_recycled.empty() && (int)m_ready.size() >= m_size) {
+            m_cond.wait(lock);
+            continue;
+        }
+
+        std::string filename;
+
+        if(!m_recycled.empty()) {
+            filename = m_recycled.front();
+            m_recycled.pop_front();
+        }
+        else {
+            filename = createFileName();
+        }
+
+        // allocating may take a while
+        lock.unlock();
+        bool success = allocate(filename);
+        lock.lock();
+
+        if(!success) {
+            unlink(filename.c_str());
+
+            // don't retry immediately (e.g. disk full)
+            m_cond.wait_for(lock, std::chrono::seconds(60));
+            continue;
+        }
+
+        m_ready.push_back(filename);
+    }
+}
+
+bool TimeShiftPool::allocate(const std::string& filename) {
+    int fd = open(filename.c_str(), O_CREAT | O_WRONLY, 0644);
+
+    if(fd == -1) {
+        esyslog("unable to create timeshift file %s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+
+    int rc = TimeShiftStorage::preallocate(fd, m_fileSize);
+
+    if(rc != 0) {
+        esyslog("unable to pre-allocate %li bytes for %s: %s", m_fileSize, filename.c_str(), strerror(rc));
+    }
+
+    close(fd);
+    return (rc == 0);
+}
+
+std::string TimeShiftPool::createFileName() {
+    return *cString::sprintf("%s/" POOL_PREFIX "%05i.data", m_directory.c_str(), m_nextIndex++);
+}
@@ -0,0 +1,122 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_TIMESHIFTPOOL_H
+#define ROBOTV_TIMESHIFTPOOL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Pool of preallocated timeshift files.
+ * A number of spare files is kept allocated in the timeshift directory,
+ * so starting a stream doesn't need to allocate disk space (which is
+ * slow on filesystems without native fallocate support). Released files
+ * are recycled. The files are allocated by a background thread and
+ * are kept across restarts.
+ */
+class TimeShiftPool {
+public:
+
+    static TimeShiftPool& instance();
+
+    /**
+     * Set the number of spare files.
+     * @param count number of files (0 = disabled)
+     */
+    void setSize(int count);
+
+    /**
+     * Start the pool.
+     * Existing timeshift files are renamed and recycled or removed.
+     * @param directory timeshift directory
+     * @param fileSize size of the files
+     */
+    void start(const std::string& directory, off_t fileSize);
+
+    void stop();
+
+    /**
+     * Take a preallocated file from the pool.
+     * The file is truncated to the requested size. If the pool is empty,
+     * a new unique filename is returned.
+     * @param size size of the file
+     * @return filename
+     */
+    std::string acquire(off_t size);
+
+    /**
+     * Return a timeshift file.
+     * The file is recycled or removed if the pool is already full.
+     * @param filename timeshift file
+     */
+    void release(const std::string& filename);
+
+    /**
+     * Get the disk space held by the spare files.
+     * @return size in bytes
+     */
+    uint64_t spareSize();
+
+private:
+
+    TimeShiftPool();
+
+    void scan();
+
+    void fill();
+
+    bool allocate(const std::string& filename);
+
+    std::string createFileName();
+
+    std::deque<std::string> m_ready;
+
+    std::deque<std::string> m_recycled;
+
+    std::string m_directory;
+
+    off_t m_fileSize;
+
+    int m_size;
+
+    int m_nextIndex;
+
+    bool m_running;
+
+    std::thread* m_thread;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_cond;
+
+};
+
+#endif // ROBOTV_TIMESHIFTPOOL_H
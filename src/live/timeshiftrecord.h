@@ -0,0 +1,95 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_TIMESHIFTRECORD_H
+#define ROBOTV_TIMESHIFTRECORD_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __FreeBSD__
+#include <sys/endian.h>
+#else
+#include <endian.h>
+#endif
+
+/**
+ * Packet record of the timeshift buffer.
+ * Records are stored in the wire layout of the ROBOTV_STREAM_RECORDS
+ * aggregate, so a range of the buffer can be sent to a client as is:
+ *
+ * offset  type       content
+ * 0       uint32_t   payload length
+ * 4       uint16_t   message id
+ * 6       uint16_t   client id
+ * 8       -          payload
+ *
+ * All values are stored in network byte order.
+ */
+struct TimeShiftRecord {
+
+    enum {
+        HeaderLength = 8,
+        LengthPos = 0,
+        MsgIDPos = 4,
+        ClientIDPos = 6
+    };
+
+    uint16_t msgId;
+
+    uint16_t clientId;
+
+    uint8_t* payload;
+
+    uint32_t length;
+
+    static void encode(uint8_t* header, uint16_t msgId, uint16_t clientId, uint32_t length) {
+        length = htobe32(length);
+        msgId = htobe16(msgId);
+        clientId = htobe16(clientId);
+
+        memcpy(header + LengthPos, &length, sizeof(length));
+        memcpy(header + MsgIDPos, &msgId, sizeof(msgId));
+        memcpy(header + ClientIDPos, &clientId, sizeof(clientId));
+    }
+
+    static TimeShiftRecord decode(uint8_t* header) {
+        TimeShiftRecord r;
+
+        memcpy(&r.length, header + LengthPos, sizeof(r.length));
+        memcpy(&r.msgId, header + MsgIDPos, sizeof(r.msgId));
+        memcpy(&r.clientId, header + ClientIDPos, sizeof(r.clientId));
+
+        r.length = be32toh(r.length);
+        r.msgId = be16toh(r.msgId);
+        r.clientId = be16toh(r.clientId);
+        r.payload = header + HeaderLength;
+
+        return r;
+    }
+
+};
+
+#endif // ROBOTV_TIMESHIFTRECORD_H
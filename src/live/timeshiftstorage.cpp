@@ -0,0 +1,93 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <vdr/tools.h>
+
+#include "timeshiftstorage.h"
+#include "filestorage.h"
+#include "mmapstorage.h"
+#include "uringstorage.h"
+
+TimeShiftStorage* TimeShiftStorage::create(const std::string& backend) {
+    if(backend == "mmap") {
+        return new MmapStorage();
+    }
+
+    if(backend == "uring") {
+#ifdef HAVE_LIBURING
+        return new UringStorage();
+#else
+        esyslog("io_uring support not compiled in - using file storage");
+        return new FileStorage();
+#endif
+    }
+
+    if(backend != "file") {
+        esyslog("unknown timeshift backend '%s' - using file storage", backend.c_str());
+    }
+
+    return new FileStorage();
+}
+
+bool TimeShiftStorage::isValid(const std::string& backend) {
+    return (backend == "file" || backend == "mmap" || backend == "uring");
+}
+
+int TimeShiftStorage::preallocate(int fd, off_t size) {
+    struct stat st;
+
+    // without native fallocate support glibc writes the whole file,
+    // so skip files that are completely allocated already
+    if(fstat(fd, &st) == 0 && st.st_size >= size && (off_t)st.st_blocks * 512 >= size) {
+        return 0;
+    }
+
+    return posix_fallocate(fd, 0, size);
+}
+
+bool TimeShiftStorage::syncRange(int fd, off_t start, off_t end) {
+    if(end <= start) {
+        return true;
+    }
+
+#ifdef __linux__
+    int flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+
+    if(sync_file_range(fd, start, end - start, flags) == 0) {
+        return true;
+    }
+
+    // not supported by the filesystem
+    if(errno != ENOSYS && errno != EINVAL && errno != ESPIPE) {
+        return false;
+    }
+#endif
+
+    return (fdatasync(fd) == 0);
+}
@@ -0,0 +1,217 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_TIMESHIFTSTORAGE_H
+#define ROBOTV_TIMESHIFTSTORAGE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <chrono>
+#include <memory>
+#include <string>
+
+/**
+ * Storage backend of the timeshift ringbuffer.
+ * The ringbuffer stores packet records (see TimeShiftRecord) at a write
+ * cursor, the read positions are kept by the consumers. All methods
+ * except readData(), fileRange() and writeBack() are called by the
+ * writer thread of the owning queue.
+ */
+class TimeShiftStorage {
+public:
+
+    /**
+     * Range of a file holding written data (see fileRange()).
+     */
+    struct FileRange {
+        std::shared_ptr<void> owner;    // keeps the file open and unmodified
+        int fd;
+        off_t offset;
+        size_t length;
+    };
+
+    virtual ~TimeShiftStorage() {}
+
+    /**
+     * Create a storage backend.
+     * @param backend name of the backend ("file", "mmap" or "uring")
+     * @return new backend, the file backend if the name is unknown
+     */
+    static TimeShiftStorage* create(const std::string& backend);
+
+    /**
+     * Check if a backend with the given name exists.
+     */
+    static bool isValid(const std::string& backend);
+
+    /**
+     * Allocate disk space for a storage file.
+     * Files already allocated (e.g. recycled files) are left untouched.
+     * @param fd file descriptor
+     * @param size number of bytes to allocate
+     * @return 0 on success, otherwise an error number
+     */
+    static int preallocate(int fd, off_t size);
+
+    /**
+     * Write a range of a file to the disk and wait for it.
+     * Only the given range is flushed (without the file metadata) if
+     * the system supports it, otherwise the whole file is synced.
+     * @param fd file descriptor
+     * @param start first byte of the range
+     * @param end end of the range (exclusive)
+     * @return true on success
+     */
+    static bool syncRange(int fd, off_t start, off_t end);
+
+    /**
+     * Create and preallocate the storage file.
+     * @param filename path of the storage file
+     * @param size number of bytes to preallocate
+     * @return true on success
+     */
+    virtual bool open(const std::string& filename, off_t size) = 0;
+
+    virtual void close() = 0;
+
+    /**
+     * @return current write cursor or -1 if the storage is not open
+     */
+    virtual off_t writePosition() = 0;
+
+    /**
+     * Move the write cursor back to the start of the storage.
+     * Data behind the current write cursor is no longer valid.
+     */
+    virtual void wrap() = 0;
+
+    /**
+     * Write data at the write cursor and advance the cursor.
+     * The buffers hold complete records.
+     * @param iov buffers to write (the array may be modified)
+     * @param iovcnt number of buffers
+     * @return true on success
+     */
+    virtual bool write(struct iovec* iov, int iovcnt) = 0;
+
+    /**
+     * Read raw data at the given position.
+     * Readers may call this concurrently with the writer thread, it
+     * must not wait for writes or syncs.
+     * @param position position of the data
+     * @param buffer destination buffer
+     * @param length number of bytes to read
+     * @return number of bytes read (may be less than requested)
+     */
+    virtual size_t readData(off_t position, uint8_t* buffer, size_t length) = 0;
+
+    /**
+     * Get written data as a range of a file, so it can be sent without
+     * copying it (sendfile). The range must not be modified as long as
+     * the owner of the range is referenced, so only storages which never
+     * overwrite data in place support this. May be called concurrently
+     * with the writer.
+     * @param position position of the data
+     * @param length number of bytes requested
+     * @param range file range (may be shorter than requested)
+     * @return false if the data isn't available as a file range
+     */
+    virtual bool fileRange(off_t position, size_t length, FileRange& range) {
+        return false;
+    }
+
+    /**
+     * @return descriptor of the file holding the written data or -1 if
+     * written data may not have reached the file yet
+     */
+    virtual int fileDescriptor() {
+        return -1;
+    }
+
+    /**
+     * Write data at the given position.
+     * The write cursor is not modified.
+     * @param position destination position
+     * @param data data to write
+     * @param length number of bytes to write
+     * @return true on success
+     */
+    virtual bool writeAt(off_t position, const uint8_t* data, size_t length) = 0;
+
+    /**
+     * Flush a written range to the disk.
+     * Called by the write-back scheduler concurrently with the writer.
+     * @param start first byte of the range
+     * @param end end of the range (exclusive)
+     */
+    virtual void writeBack(off_t start, off_t end) = 0;
+
+    /**
+     * Check if the storage can grow beyond the size passed to open().
+     */
+    virtual bool resizable() const {
+        return true;
+    }
+
+    /**
+     * Check if the storage grows by segments instead of wrapping.
+     * Positions of segmented storages increase monotonically,
+     * wrap() starts a new segment.
+     */
+    virtual bool segmented() const {
+        return false;
+    }
+
+    /**
+     * Check if a new segment should be started before writing at the
+     * given position (segmented storages only).
+     */
+    virtual bool segmentFull(off_t position) {
+        return false;
+    }
+
+    /**
+     * @return position of the oldest data
+     */
+    virtual off_t startPosition() {
+        return 0;
+    }
+
+    /**
+     * Release the oldest segments (segmented storages only).
+     * Segments are released until the storage holds at most maxSize bytes
+     * and no data older than maxAge. The current segment is always kept.
+     * @param maxSize maximum size in bytes
+     * @param maxAge maximum age of the data (0 = no limit)
+     */
+    virtual void retain(off_t maxSize, std::chrono::milliseconds maxAge) {
+    }
+
+    virtual const char* name() const = 0;
+
+};
+
+#endif // ROBOTV_TIMESHIFTSTORAGE_H
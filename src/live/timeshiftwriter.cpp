@@ -0,0 +1,191 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <algorithm>
+#include <vdr/tools.h>
+
+#include "timeshiftwriter.h"
+#include "livequeue.h"
+#include "tools/json.hpp"
+#include "tools/statistics.h"
+
+TimeShiftWriter::TimeShiftWriter() : m_threadCount(2), m_running(false) {
+}
+
+TimeShiftWriter::~TimeShiftWriter() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+
+    m_cond.notify_all();
+
+    for(auto t : m_threads) {
+        t->join();
+        delete t;
+    }
+}
+
+TimeShiftWriter& TimeShiftWriter::instance() {
+    static TimeShiftWriter writer;
+    return writer;
+}
+
+void TimeShiftWriter::setThreads(int count) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_threadCount = std::max(count, 1);
+    isyslog("timeshift writer threads: %i", m_threadCount);
+}
+
+void TimeShiftWriter::attach(int id, LiveQueue* queue) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_streams[id] = { queue, false, Clock::now(), 0 };
+
+    if(!m_threads.empty()) {
+        return;
+    }
+
+    m_running = true;
+
+    for(int i = 0; i < m_threadCount; i++) {
+        m_threads.push_back(new std::thread([&]() {
+            run();
+        }));
+    }
+}
+
+void TimeShiftWriter::detach(int id) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_runQueue.erase(std::remove(m_runQueue.begin(), m_runQueue.end(), id), m_runQueue.end());
+
+    // the queue must stay alive until the batch is written
+    m_idleCond.wait(lock, [&]() {
+        auto i = m_streams.find(id);
+        return i == m_streams.end() || !i->second.busy;
+    });
+
+    // the stream may have been rescheduled by the last batch
+    m_runQueue.erase(std::remove(m_runQueue.begin(), m_runQueue.end(), id), m_runQueue.end());
+    m_streams.erase(id);
+}
+
+void TimeShiftWriter::schedule(int id) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto i = m_streams.find(id);
+
+        if(i == m_streams.end()) {
+            return;
+        }
+
+        i->second.scheduled = Clock::now();
+        m_runQueue.push_back(id);
+    }
+
+    m_cond.notify_one();
+}
+
+void TimeShiftWriter::run() {
+    static auto& batches = roboTV::Statistics::instance().counter("timeshift.writer.batches");
+    static auto& scheduleWait = roboTV::Statistics::instance().counter("timeshift.writer.scheduleWaitUs");
+    static auto& maxRunQueue = roboTV::Statistics::instance().maximum("timeshift.writer.maxRunQueue");
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while(m_running) {
+        if(m_runQueue.empty()) {
+            m_cond.wait(lock);
+            continue;
+        }
+
+        maxRunQueue.update(m_runQueue.size());
+
+        int id = m_runQueue.front();
+        m_runQueue.pop_front();
+
+        auto i = m_streams.find(id);
+
+        if(i == m_streams.end()) {
+            continue;
+        }
+
+        Stream& stream = i->second;
+        auto now = Clock::now();
+
+        scheduleWait += std::chrono::duration_cast<std::chrono::microseconds>(now - stream.scheduled).count();
+        stream.busy = true;
+        lock.unlock();
+
+        bool pending = stream.queue->writeBatch();
+
+        // the stream can't be erased while it's busy
+        lock.lock();
+        stream.busy = false;
+        stream.batches++;
+        batches++;
+
+        // more packets - back to the end of the line
+        if(pending) {
+            stream.scheduled = Clock::now();
+            m_runQueue.push_back(id);
+        }
+
+        m_idleCond.notify_all();
+    }
+}
+
+std::string TimeShiftWriter::report() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    nlohmann::json streams = nlohmann::json::array();
+    auto now = Clock::now();
+
+    for(auto& i : m_streams) {
+        bool waiting = std::find(m_runQueue.begin(), m_runQueue.end(), i.first) != m_runQueue.end();
+        int64_t waitMs = 0;
+
+        if(waiting) {
+            waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - i.second.scheduled).count();
+        }
+
+        streams.push_back({
+            { "id", i.first },
+            { "backlog", i.second.queue->backlog() },
+            { "waiting", waiting },
+            { "waitMs", waitMs },
+            { "busy", i.second.busy },
+            { "batches", i.second.batches }
+        });
+    }
+
+    nlohmann::json result = {
+        { "threads", m_threadCount },
+        { "runQueue", m_runQueue.size() },
+        { "streams", streams }
+    };
+
+    return result.dump();
+}
@@ -0,0 +1,120 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_TIMESHIFTWRITER_H
+#define ROBOTV_TIMESHIFTWRITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class LiveQueue;
+
+/**
+ * Shared writer threads of the timeshift buffers.
+ * A fixed number of threads (sized to the disks, not to the clients)
+ * writes the packets of all streams. Streams with pending packets are
+ * serviced round-robin, one batch at a time, so a busy stream can't
+ * starve the others. A stream is never serviced by two threads at once.
+ */
+class TimeShiftWriter {
+public:
+
+    static TimeShiftWriter& instance();
+
+    ~TimeShiftWriter();
+
+    /**
+     * Set the number of writer threads.
+     * Takes effect when the threads are started by the first stream.
+     * @param count number of threads
+     */
+    void setThreads(int count);
+
+    /**
+     * Register a stream.
+     * @param id id of the stream
+     * @param queue queue of the stream
+     */
+    void attach(int id, LiveQueue* queue);
+
+    /**
+     * Unregister a stream.
+     * Waits until a running batch of the stream has been written.
+     * @param id id of the stream
+     */
+    void detach(int id);
+
+    /**
+     * Queue a stream with pending packets for service (any thread).
+     * @param id id of the stream
+     */
+    void schedule(int id);
+
+    /**
+     * Get the backlog of all streams.
+     * @return report in JSON format
+     */
+    std::string report();
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Stream {
+        LiveQueue* queue;
+        bool busy;
+        Clock::time_point scheduled;
+        uint64_t batches;
+    };
+
+    TimeShiftWriter();
+
+    void run();
+
+    std::map<int, Stream> m_streams;
+
+    std::deque<int> m_runQueue;
+
+    int m_threadCount;
+
+    bool m_running;
+
+    std::vector<std::thread*> m_threads;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_cond;
+
+    std::condition_variable m_idleCond;
+
+};
+
+#endif // ROBOTV_TIMESHIFTWRITER_H
@@ -0,0 +1,512 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifdef HAVE_LIBURING
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <vdr/tools.h>
+
+#include "uringstorage.h"
+
+#define URING_QUEUE_DEPTH 32
+#define URING_SLOT_SIZE (256 * 1024)
+#define URING_BLOCK_SIZE 4096
+
+static size_t blockAlign(size_t length) {
+    return (length + URING_BLOCK_SIZE - 1) & ~(size_t)(URING_BLOCK_SIZE - 1);
+}
+
+UringStorage::UringStorage() :
+    m_ringOpen(false),
+    m_direct(false),
+    m_fixedBuffers(false),
+    m_failed(false),
+    m_fd(-1),
+    m_buffers(nullptr),
+    m_current(0) {
+    memset(m_slots, 0, sizeof(m_slots));
+}
+
+UringStorage::~UringStorage() {
+    close();
+}
+
+bool UringStorage::open(const std::string& filename, off_t size) {
+    int rc = io_uring_queue_init(URING_QUEUE_DEPTH, &m_ring, 0);
+
+    if(rc < 0) {
+        esyslog("io_uring not available: %s", strerror(-rc));
+        return false;
+    }
+
+    m_ringOpen = true;
+
+    // O_DIRECT isn't supported by all filesystems (e.g. tmpfs)
+    m_fd = ::open(filename.c_str(), O_CREAT | O_RDWR | O_DIRECT, 0644);
+    m_direct = (m_fd != -1);
+
+    if(m_fd == -1) {
+        m_fd = ::open(filename.c_str(), O_CREAT | O_RDWR, 0644);
+    }
+
+    if(m_fd == -1) {
+        esyslog("unable to create timeshift file: %s", strerror(errno));
+        close();
+        return false;
+    }
+
+    rc = preallocate(m_fd, size);
+
+    if(rc != 0) {
+        dsyslog("unable to pre-allocate %li bytes for timeshift ringbuffer", size);
+        dsyslog("ERROR: %s (status = %i)", strerror(rc), rc);
+    }
+
+    if(posix_memalign((void**)&m_buffers, URING_BLOCK_SIZE, URING_SLOT_SIZE * URING_SLOT_COUNT) != 0) {
+        m_buffers = nullptr;
+        esyslog("unable to allocate io_uring buffers");
+        close();
+        return false;
+    }
+
+    struct iovec iov[URING_SLOT_COUNT];
+
+    for(int i = 0; i < URING_SLOT_COUNT; i++) {
+        m_slots[i] = { m_buffers + i * URING_SLOT_SIZE, 0, 0, false, 0 };
+        iov[i].iov_base = m_slots[i].data;
+        iov[i].iov_len = URING_SLOT_SIZE;
+    }
+
+    // registered buffers are pinned once, not on every write
+    // (this may fail if RLIMIT_MEMLOCK is too low)
+    m_fixedBuffers = (io_uring_register_buffers(&m_ring, iov, URING_SLOT_COUNT) == 0);
+
+    m_current = 0;
+    m_failed = false;
+
+    isyslog("io_uring timeshift storage (%s, %s buffers)",
+            m_direct ? "direct I/O" : "buffered I/O",
+            m_fixedBuffers ? "registered" : "unregistered");
+
+    return true;
+}
+
+void UringStorage::close() {
+    if(m_ringOpen) {
+        drain();
+
+        if(m_fixedBuffers) {
+            io_uring_unregister_buffers(&m_ring);
+        }
+
+        io_uring_queue_exit(&m_ring);
+    }
+
+    if(m_fd != -1) {
+        ::close(m_fd);
+    }
+
+    free(m_buffers);
+
+    m_ringOpen = false;
+    m_fixedBuffers = false;
+    m_fd = -1;
+    m_buffers = nullptr;
+
+    memset(m_slots, 0, sizeof(m_slots));
+}
+
+off_t UringStorage::writePosition() {
+    if(m_fd == -1) {
+        return -1;
+    }
+
+    auto& s = m_slots[m_current];
+    return s.offset + s.length;
+}
+
+void UringStorage::wrap() {
+    off_t end = writePosition();
+
+    // write out the partial buffer in front of the wrap
+    if(m_slots[m_current].length > 0) {
+        submitSlot(m_current);
+        nextSlot(0);
+    }
+    else {
+        std::lock_guard<std::mutex> lock(m_slotMutex);
+        m_slots[m_current].offset = 0;
+    }
+
+    // release the space behind the wrap (the buffer may have shrunk)
+    drain();
+
+    if(ftruncate(m_fd, m_direct ? blockAlign(end) : end) == -1) {
+        esyslog("truncating the timeshift buffer failed: %i - %s", errno, strerror(errno));
+    }
+}
+
+bool UringStorage::write(struct iovec* iov, int iovcnt) {
+    for(int i = 0; i < iovcnt; i++) {
+        append((const uint8_t*)iov[i].iov_base, iov[i].iov_len);
+    }
+
+    // reap finished writes
+    while(complete(false));
+
+    bool success = !m_failed;
+    m_failed = false;
+
+    return success;
+}
+
+size_t UringStorage::readData(off_t position, uint8_t* buffer, size_t length) {
+    return readBytes(position, buffer, length) ? length : 0;
+}
+
+bool UringStorage::writeAt(off_t position, const uint8_t* data, size_t length) {
+    // the spills of the RAM tier are mostly sequential. continue the
+    // buffers at the new position, so all writes go through the ring.
+    if(position != writePosition() && !seek(position)) {
+        return false;
+    }
+
+    struct iovec iov = { (void*)data, length };
+    return write(&iov, 1);
+}
+
+void UringStorage::writeBack(off_t start, off_t end) {
+    // direct I/O doesn't leave dirty pages behind
+    if(m_direct) {
+        return;
+    }
+
+    // data still in the buffers is written by the ring
+    if(!syncRange(m_fd, start, end)) {
+        esyslog("Failed to sync timeshift ring-buffer !");
+    }
+}
+
+bool UringStorage::seek(off_t position) {
+    auto& current = m_slots[m_current];
+
+    // write out the current buffer. direct I/O writes whole blocks, so
+    // keep the data behind its end (e.g. written by an earlier seek).
+    if(current.length > 0) {
+        size_t tail = (m_direct ? blockAlign(current.length) : current.length) - current.length;
+
+        if(tail > 0) {
+            drain();
+
+            if(!readFile(current.offset + current.length, current.data + current.length, tail)) {
+                memset(current.data + current.length, 0, tail);
+            }
+        }
+
+        submitSlot(m_current);
+    }
+
+    // the next buffer may start in the same block
+    drain();
+
+    // direct I/O writes whole blocks. start with the data
+    // in front of the position (zero behind the end of the file).
+    off_t start = m_direct ? (position & ~(off_t)(URING_BLOCK_SIZE - 1)) : position;
+    size_t head = position - start;
+
+    nextSlot(start);
+
+    auto& s = m_slots[m_current];
+
+    if(head > 0 && !readFile(start, s.data, head)) {
+        memset(s.data, 0, head);
+    }
+
+    std::lock_guard<std::mutex> lock(m_slotMutex);
+    s.length = head;
+
+    return !m_failed;
+}
+
+void UringStorage::append(const uint8_t* data, size_t length) {
+    while(length > 0) {
+        auto& s = m_slots[m_current];
+        size_t count = std::min(length, (size_t)URING_SLOT_SIZE - s.length);
+
+        // the space behind the length isn't visible to the readers
+        memcpy(s.data + s.length, data, count);
+
+        {
+            std::lock_guard<std::mutex> lock(m_slotMutex);
+            s.length += count;
+        }
+
+        data += count;
+        length -= count;
+
+        if(s.length == URING_SLOT_SIZE) {
+            submitSlot(m_current);
+            nextSlot(s.offset + URING_SLOT_SIZE);
+        }
+    }
+}
+
+void UringStorage::submitSlot(int index) {
+    auto& s = m_slots[index];
+    struct io_uring_sqe* sqe = getSqe();
+
+    if(sqe == nullptr) {
+        m_failed = true;
+        return;
+    }
+
+    // direct I/O needs block aligned transfers. the padding is
+    // located behind the write position and will be overwritten.
+    size_t length = m_direct ? blockAlign(s.length) : s.length;
+
+    if(m_fixedBuffers) {
+        io_uring_prep_write_fixed(sqe, m_fd, s.data, length, s.offset, index);
+    }
+    else {
+        io_uring_prep_write(sqe, m_fd, s.data, length, s.offset);
+    }
+
+    io_uring_sqe_set_data(sqe, (void*)(uintptr_t)index);
+
+    {
+        std::lock_guard<std::mutex> lock(m_slotMutex);
+        s.inflight = true;
+    }
+
+    io_uring_submit(&m_ring);
+}
+
+void UringStorage::nextSlot(off_t offset) {
+    int next = (m_current + 1) % URING_SLOT_COUNT;
+    auto& s = m_slots[next];
+
+    // wait until the buffer has been written
+    while(s.inflight && complete(true));
+
+    std::lock_guard<std::mutex> lock(m_slotMutex);
+
+    m_current = next;
+    s.offset = offset;
+    s.length = 0;
+    s.inflight = false;
+    s.generation++;
+}
+
+struct io_uring_sqe* UringStorage::getSqe() {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+
+    // submission queue full - wait for a completion
+    while(sqe == nullptr && complete(true)) {
+        sqe = io_uring_get_sqe(&m_ring);
+    }
+
+    return sqe;
+}
+
+bool UringStorage::complete(bool wait) {
+    struct io_uring_cqe* cqe = nullptr;
+    int rc;
+
+    do {
+        rc = wait ? io_uring_wait_cqe(&m_ring, &cqe) : io_uring_peek_cqe(&m_ring, &cqe);
+    }
+    while(rc == -EINTR);
+
+    if(rc == -EAGAIN && !wait) {
+        return false;
+    }
+
+    if(rc < 0) {
+        esyslog("io_uring completion failed: %s", strerror(-rc));
+
+        // nothing will complete anymore
+        {
+            std::lock_guard<std::mutex> lock(m_slotMutex);
+
+            for(auto& s : m_slots) {
+                s.inflight = false;
+            }
+        }
+
+        m_failed = true;
+        return false;
+    }
+
+    uintptr_t tag = (uintptr_t)io_uring_cqe_get_data(cqe);
+    int res = cqe->res;
+
+    io_uring_cqe_seen(&m_ring, cqe);
+
+    auto& s = m_slots[tag];
+
+    {
+        std::lock_guard<std::mutex> lock(m_slotMutex);
+        s.inflight = false;
+    }
+
+    if(res < 0 || (size_t)res < s.length) {
+        esyslog("timeshift write failed: %s", res < 0 ? strerror(-res) : "short write");
+        m_failed = true;
+    }
+
+    return true;
+}
+
+void UringStorage::drain() {
+    auto pending = [&]() {
+        for(auto& s : m_slots) {
+            if(s.inflight) {
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    while(pending() && complete(true));
+}
+
+bool UringStorage::readBytes(off_t position, uint8_t* buffer, size_t length) {
+    off_t end = position + (off_t)length;
+
+    for(;;) {
+        uint64_t generation[URING_SLOT_COUNT];
+        bool pending[URING_SLOT_COUNT];
+
+        {
+            std::lock_guard<std::mutex> lock(m_slotMutex);
+            auto& current = m_slots[m_current];
+
+            // data is still in the current buffer
+            if(position >= current.offset && end <= current.offset + (off_t)current.length) {
+                memcpy(buffer, current.data + (position - current.offset), length);
+                return true;
+            }
+
+            // the data of all other buffers is already on the disk
+            for(int i = 0; i < URING_SLOT_COUNT; i++) {
+                pending[i] = (m_slots[i].inflight || i == m_current);
+                generation[i] = m_slots[i].generation;
+            }
+        }
+
+        if(!readFile(position, buffer, length)) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_slotMutex);
+        bool reused = false;
+
+        // pending writes are newer than the data on disk
+        for(int i = 0; i < URING_SLOT_COUNT && !reused; i++) {
+            auto& s = m_slots[i];
+
+            if(!pending[i]) {
+                continue;
+            }
+
+            // the buffer has been reused while we were reading the file.
+            // the file may hold older data than the buffer had.
+            if(s.generation != generation[i]) {
+                reused = true;
+                continue;
+            }
+
+            off_t from = std::max(position, s.offset);
+            off_t to = std::min(end, s.offset + (off_t)s.length);
+
+            if(from < to) {
+                memcpy(buffer + (from - position), s.data + (from - s.offset), to - from);
+            }
+        }
+
+        if(!reused) {
+            return true;
+        }
+    }
+}
+
+bool UringStorage::readFile(off_t position, uint8_t* buffer, size_t length) {
+    off_t start = position;
+    size_t size = length;
+    uint8_t* target = buffer;
+
+    // direct I/O needs an aligned bounce buffer. every reader
+    // keeps its own, grown to the largest read so far.
+    if(m_direct) {
+        start = position & ~(off_t)(URING_BLOCK_SIZE - 1);
+        size = blockAlign(position + length - start);
+
+        static thread_local BounceBuffer bounce;
+
+        if(bounce.size < size) {
+            free(bounce.data);
+            bounce.size = 0;
+
+            if(posix_memalign((void**)&bounce.data, URING_BLOCK_SIZE, size) != 0) {
+                bounce.data = nullptr;
+                return false;
+            }
+
+            bounce.size = size;
+        }
+
+        target = bounce.data;
+    }
+
+    size_t done = 0;
+    size_t needed = (position - start) + length;
+
+    while(done < needed) {
+        ssize_t rc = pread(m_fd, target + done, size - done, start + done);
+
+        if(rc == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if(rc <= 0) {
+            break;
+        }
+
+        done += rc;
+    }
+
+    if(target != buffer && done >= needed) {
+        memcpy(buffer, target + (position - start), length);
+    }
+
+    return (done >= needed);
+}
+
+#endif // HAVE_LIBURING
@@ -0,0 +1,138 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_URINGSTORAGE_H
+#define ROBOTV_URINGSTORAGE_H
+
+#ifdef HAVE_LIBURING
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <liburing.h>
+#include <mutex>
+#include "timeshiftstorage.h"
+
+#define URING_SLOT_COUNT 8
+
+/**
+ * Timeshift storage using asynchronous I/O (io_uring).
+ * Written packets are collected in a set of registered buffers. Each
+ * filled buffer is submitted as a single write, so the writer thread
+ * does not block on disk latency. The file is opened with O_DIRECT if
+ * the filesystem supports it. Data not yet written to the disk is
+ * served from the buffers. Readers don't use the ring, they read the
+ * file directly and only lock the buffer state, so they never wait for
+ * a submission or a completion of the writer.
+ */
+class UringStorage : public TimeShiftStorage {
+public:
+
+    UringStorage();
+
+    virtual ~UringStorage();
+
+    bool open(const std::string& filename, off_t size);
+
+    void close();
+
+    off_t writePosition();
+
+    void wrap();
+
+    bool write(struct iovec* iov, int iovcnt);
+
+    size_t readData(off_t position, uint8_t* buffer, size_t length);
+
+    bool writeAt(off_t position, const uint8_t* data, size_t length);
+
+    void writeBack(off_t start, off_t end);
+
+    const char* name() const {
+        return "uring";
+    }
+
+private:
+
+    struct Slot {
+        uint8_t* data;
+        off_t offset;
+        size_t length;
+        bool inflight;
+        uint64_t generation;
+    };
+
+    struct BounceBuffer {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+
+        ~BounceBuffer() {
+            free(data);
+        }
+    };
+
+    bool seek(off_t position);
+
+    void append(const uint8_t* data, size_t length);
+
+    void submitSlot(int index);
+
+    void nextSlot(off_t offset);
+
+    struct io_uring_sqe* getSqe();
+
+    bool complete(bool wait);
+
+    void drain();
+
+    bool readBytes(off_t position, uint8_t* buffer, size_t length);
+
+    bool readFile(off_t position, uint8_t* buffer, size_t length);
+
+    struct io_uring m_ring;
+
+    bool m_ringOpen;
+
+    bool m_direct;
+
+    bool m_fixedBuffers;
+
+    bool m_failed;
+
+    int m_fd;
+
+    uint8_t* m_buffers;
+
+    Slot m_slots[URING_SLOT_COUNT];
+
+    // protects the buffer state against the readers
+    std::mutex m_slotMutex;
+
+    int m_current;
+
+};
+
+#endif // HAVE_LIBURING
+
+#endif // ROBOTV_URINGSTORAGE_H
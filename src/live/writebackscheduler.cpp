@@ -0,0 +1,192 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <vdr/tools.h>
+
+#include "writebackscheduler.h"
+#include "timeshiftstorage.h"
+#include "tools/statistics.h"
+
+// flushes slower than this are logged
+#define SLOW_FLUSH_US 500000
+
+WriteBackScheduler::WriteBackScheduler() : m_interval(2000), m_flushing(-1), m_running(false), m_thread(nullptr) {
+}
+
+WriteBackScheduler::~WriteBackScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+
+    m_cond.notify_all();
+
+    if(m_thread != nullptr) {
+        m_thread->join();
+    }
+
+    delete m_thread;
+}
+
+WriteBackScheduler& WriteBackScheduler::instance() {
+    static WriteBackScheduler scheduler;
+    return scheduler;
+}
+
+void WriteBackScheduler::setInterval(int ms) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_interval = std::chrono::milliseconds(ms);
+    isyslog("timeshift write-back interval: %i ms", ms);
+}
+
+void WriteBackScheduler::attach(int id, TimeShiftStorage* storage) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_streams[id] = { storage, {}, Clock::now() + m_interval };
+
+    if(m_thread != nullptr) {
+        return;
+    }
+
+    m_running = true;
+    m_thread = new std::thread([&]() {
+        run();
+    });
+}
+
+void WriteBackScheduler::detach(int id) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // the storage must stay alive until the flush is done
+    m_cond.wait(lock, [&]() {
+        return m_flushing != id;
+    });
+
+    m_streams.erase(id);
+}
+
+void WriteBackScheduler::written(int id, off_t start, off_t end) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if(m_interval.count() == 0) {
+        return;
+    }
+
+    auto i = m_streams.find(id);
+
+    if(i == m_streams.end()) {
+        return;
+    }
+
+    auto& ranges = i->second.ranges;
+
+    // extend the last range (there's a new one after a wrap)
+    if(!ranges.empty() && ranges.back().end == start) {
+        ranges.back().end = end;
+        return;
+    }
+
+    ranges.push_back({ start, end });
+
+    if(ranges.size() == 1) {
+        m_cond.notify_all();
+    }
+}
+
+void WriteBackScheduler::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while(m_running) {
+        // the stream waiting the longest
+        auto next = m_streams.end();
+
+        for(auto i = m_streams.begin(); i != m_streams.end(); i++) {
+            if(!i->second.ranges.empty() && (next == m_streams.end() || i->second.due < next->second.due)) {
+                next = i;
+            }
+        }
+
+        if(next == m_streams.end()) {
+            m_cond.wait(lock);
+            continue;
+        }
+
+        // spread the flushes of all streams over the interval
+        auto gap = m_interval / (int)m_streams.size();
+        auto when = std::max(next->second.due, m_lastFlush + gap);
+
+        if(Clock::now() < when) {
+            m_cond.wait_until(lock, when);
+            continue;
+        }
+
+        int id = next->first;
+        TimeShiftStorage* storage = next->second.storage;
+
+        std::vector<Range> ranges;
+        ranges.swap(next->second.ranges);
+
+        m_flushing = id;
+        lock.unlock();
+
+        flush(storage, ranges);
+
+        lock.lock();
+        m_flushing = -1;
+        m_lastFlush = Clock::now();
+
+        auto i = m_streams.find(id);
+
+        if(i != m_streams.end()) {
+            i->second.due = m_lastFlush + m_interval;
+        }
+
+        m_cond.notify_all();
+    }
+}
+
+void WriteBackScheduler::flush(TimeShiftStorage* storage, const std::vector<Range>& ranges) {
+    static auto& flushes = roboTV::Statistics::instance().counter("timeshift.writeback.flushes");
+    static auto& bytes = roboTV::Statistics::instance().counter("timeshift.writeback.bytes");
+    static auto& stallTime = roboTV::Statistics::instance().counter("timeshift.writeback.stallUs");
+    static auto& maxStallTime = roboTV::Statistics::instance().maximum("timeshift.writeback.maxStallUs");
+
+    auto start = Clock::now();
+
+    for(auto& r : ranges) {
+        storage->writeBack(r.start, r.end);
+        bytes += r.end - r.start;
+    }
+
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+
+    flushes++;
+    stallTime += us;
+
+    maxStallTime.update(us);
+
+    if(us > SLOW_FLUSH_US) {
+        isyslog("timeshift write-back took %lu ms", us / 1000);
+    }
+}
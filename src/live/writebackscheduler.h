@@ -0,0 +1,119 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef ROBOTV_WRITEBACKSCHEDULER_H
+#define ROBOTV_WRITEBACKSCHEDULER_H
+
+#include <sys/types.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TimeShiftStorage;
+
+/**
+ * Background write-back of the timeshift buffers.
+ * The writer threads only report the ranges they have written. A single
+ * thread flushes the ranges of each stream periodically, so the writers
+ * never wait for the disk. The flushes of different streams are spread
+ * over the interval instead of hitting the disk at the same time.
+ */
+class WriteBackScheduler {
+public:
+
+    static WriteBackScheduler& instance();
+
+    ~WriteBackScheduler();
+
+    /**
+     * Set the write-back interval of a stream.
+     * @param ms interval in milliseconds (0 = leave it to the kernel)
+     */
+    void setInterval(int ms);
+
+    /**
+     * Register a stream.
+     * @param id id of the stream
+     * @param storage storage of the stream
+     */
+    void attach(int id, TimeShiftStorage* storage);
+
+    /**
+     * Unregister a stream.
+     * Waits until a running flush of the stream has finished.
+     * @param id id of the stream
+     */
+    void detach(int id);
+
+    /**
+     * Report a written range (writer thread).
+     * @param id id of the stream
+     * @param start first byte of the range
+     * @param end end of the range (exclusive)
+     */
+    void written(int id, off_t start, off_t end);
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Range {
+        off_t start;
+        off_t end;
+    };
+
+    struct Stream {
+        TimeShiftStorage* storage;
+        std::vector<Range> ranges;
+        Clock::time_point due;
+    };
+
+    WriteBackScheduler();
+
+    void run();
+
+    void flush(TimeShiftStorage* storage, const std::vector<Range>& ranges);
+
+    std::map<int, Stream> m_streams;
+
+    std::chrono::milliseconds m_interval;
+
+    Clock::time_point m_lastFlush;
+
+    int m_flushing;
+
+    bool m_running;
+
+    std::thread* m_thread;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_cond;
+
+};
+
+#endif // ROBOTV_WRITEBACKSCHEDULER_H
@@ -6,6 +6,14 @@
 #include <zlib.h>
 #endif
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -14,6 +22,8 @@
 
 #include "os-config.h"
 #include "msgpacket.h"
+#include "packetpool.h"
+#include "tools/crc32.h"
 
 #define get_impl(T, f) \
 	if((m_readposition + sizeof(T)) > m_usage) { \
@@ -31,86 +41,183 @@
 	m_usage += sizeof(T); \
 	return true
 
-pthread_mutex_t MsgPacket::uidmutex = PTHREAD_MUTEX_INITIALIZER;
-
-uint32_t MsgPacket::globalUID = 1;
-
-uint32_t MsgPacket::crc32_tab[] = {
-    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
-    0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
-    0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
-    0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
-    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
-    0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
-    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
-    0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
-    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
-    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
-    0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
-    0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
-    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
-    0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
-    0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
-    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
-    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
-    0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
-    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
-    0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
-    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
-    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
-    0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
-    0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
-    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
-    0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
-    0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
-    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
-    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
-    0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
-    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
-    0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
-    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
-    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
-    0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
-    0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
-    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
-    0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
-    0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
-    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
-    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
-    0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
-    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
+std::atomic<uint32_t> MsgPacket::globalUID(1);
+
+namespace {
+
+// compression contexts are kept per thread and reused for every packet
+
+#ifdef HAVE_ZLIB
+struct ZlibContext {
+    z_stream stream;
+    int level = -1;
+
+    ~ZlibContext() {
+        if(level != -1) {
+            deflateEnd(&stream);
+        }
+    }
+
+    z_stream* get(int l) {
+        if(level == -1) {
+            memset(&stream, 0, sizeof(stream));
+
+            if(deflateInit(&stream, l) != Z_OK) {
+                return NULL;
+            }
+        }
+        else {
+            deflateReset(&stream);
+
+            if(l != level && deflateParams(&stream, l, Z_DEFAULT_STRATEGY) != Z_OK) {
+                return NULL;
+            }
+        }
+
+        level = l;
+        return &stream;
+    }
 };
 
+thread_local ZlibContext zlibContext;
+#endif
+
+#ifdef HAVE_ZSTD
+struct ZstdContext {
+    ZSTD_CCtx* cctx = NULL;
+    ZSTD_DCtx* dctx = NULL;
 
-MsgPacket::MsgPacket() : m_packet(NULL), m_size(InitialPacketSize), m_usage(HeaderLength), m_readposition(HeaderLength), m_freezed(false), m_payloadchecksum(true) {
+    ~ZstdContext() {
+        ZSTD_freeCCtx(cctx);
+        ZSTD_freeDCtx(dctx);
+    }
+};
+
+thread_local ZstdContext zstdContext;
+#endif
+
+#ifdef HAVE_LZ4
+struct Lz4Context {
+    void* state = NULL;
+
+    ~Lz4Context() {
+        free(state);
+    }
+};
+
+thread_local Lz4Context lz4Context;
+#endif
+
+size_t compressData(MsgPacket::Codec codec, int level, uint8_t* dst, size_t dstSize, const uint8_t* src, size_t srcSize) {
+    switch(codec) {
+#ifdef HAVE_ZLIB
+        case MsgPacket::CodecZlib: {
+            z_stream* stream = zlibContext.get(level);
+
+            if(stream == NULL) {
+                return 0;
+            }
+
+            stream->next_in = (Bytef*)src;
+            stream->avail_in = srcSize;
+            stream->next_out = dst;
+            stream->avail_out = dstSize;
+
+            if(deflate(stream, Z_FINISH) != Z_STREAM_END) {
+                return 0;
+            }
+
+            return stream->total_out;
+        }
+#endif
+#ifdef HAVE_ZSTD
+        case MsgPacket::CodecZstd: {
+            if(zstdContext.cctx == NULL && (zstdContext.cctx = ZSTD_createCCtx()) == NULL) {
+                return 0;
+            }
+
+            size_t rc = ZSTD_compressCCtx(zstdContext.cctx, dst, dstSize, src, srcSize, level);
+            return ZSTD_isError(rc) ? 0 : rc;
+        }
+#endif
+#ifdef HAVE_LZ4
+        case MsgPacket::CodecLz4: {
+            if(lz4Context.state == NULL && (lz4Context.state = malloc(LZ4_sizeofState())) == NULL) {
+                return 0;
+            }
+
+            int rc = LZ4_compress_fast_extState(lz4Context.state, (const char*)src, (char*)dst, (int)srcSize, (int)dstSize, level);
+            return (rc <= 0) ? 0 : rc;
+        }
+#endif
+        default:
+            return 0;
+    }
+}
+
+bool uncompressData(MsgPacket::Codec codec, uint8_t* dst, size_t dstSize, const uint8_t* src, size_t srcSize) {
+    switch(codec) {
+#ifdef HAVE_ZLIB
+        case MsgPacket::CodecZlib: {
+            uLongf size = dstSize;
+            return (::uncompress(dst, &size, src, srcSize) == Z_OK && size == dstSize);
+        }
+#endif
+#ifdef HAVE_ZSTD
+        case MsgPacket::CodecZstd: {
+            if(zstdContext.dctx == NULL && (zstdContext.dctx = ZSTD_createDCtx()) == NULL) {
+                return false;
+            }
+
+            size_t rc = ZSTD_decompressDCtx(zstdContext.dctx, dst, dstSize, src, srcSize);
+            return (!ZSTD_isError(rc) && rc == dstSize);
+        }
+#endif
+#ifdef HAVE_LZ4
+        case MsgPacket::CodecLz4:
+            return (LZ4_decompress_safe((const char*)src, (char*)dst, (int)srcSize, (int)dstSize) == (int)dstSize);
+#endif
+        default:
+            return false;
+    }
+}
+
+}
+
+
+MsgPacket::MsgPacket() : m_packet(NULL), m_size(InitialPacketSize), m_usage(HeaderLength), m_readposition(HeaderLength), m_freezed(false), m_payloadchecksum(true), m_compressionRequested(false), m_fileDescriptor(-1), m_fileOffset(0), m_fileLength(0) {
     Init(0, 0, 0);
 }
 
-MsgPacket::MsgPacket(uint16_t msgid, uint16_t type, uint32_t uid) : m_packet(NULL), m_size(InitialPacketSize), m_usage(HeaderLength), m_readposition(HeaderLength), m_freezed(false), m_payloadchecksum(true) {
-    Init(msgid, type, uid);
+MsgPacket::MsgPacket(uint16_t msgid, uint16_t type, uint32_t uid, uint32_t payloadSize) : m_packet(NULL), m_size(InitialPacketSize), m_usage(HeaderLength), m_readposition(HeaderLength), m_freezed(false), m_payloadchecksum(true), m_compressionRequested(false), m_fileDescriptor(-1), m_fileOffset(0), m_fileLength(0) {
+    Init(msgid, type, uid, payloadSize);
 }
 
 MsgPacket::~MsgPacket() {
-    free(m_packet);
+    PacketPool::release(m_packet, m_size);
 }
 
-void MsgPacket::Init(uint16_t msgid, uint16_t type, uint32_t uid) {
-    m_packet = (uint8_t*)malloc(m_size);
+void MsgPacket::Init(uint16_t msgid, uint16_t type, uint32_t uid, uint32_t payloadSize) {
+    if(HeaderLength + payloadSize > m_size) {
+        m_size = HeaderLength + payloadSize;
+    }
+
+    m_packet = PacketPool::allocate(m_size, m_size);
 
     if(m_packet == NULL) {
+        m_size = 0;
         return;
     }
 
-    pthread_mutex_lock(&uidmutex);
-
     if(uid <= 0) {
-        uid = globalUID++;
-    }
-    else if(uid > globalUID) {
-        globalUID = uid + 1;
+        uid = globalUID.fetch_add(1, std::memory_order_relaxed);
     }
+    else {
+        uint32_t current = globalUID.load(std::memory_order_relaxed);
 
-    pthread_mutex_unlock(&uidmutex);
+        while(uid >= current && !globalUID.compare_exchange_weak(current, uid + 1, std::memory_order_relaxed)) {
+        }
+    }
 
     memset(m_packet, 0, HeaderLength);
 
@@ -140,6 +247,26 @@ void MsgPacket::disablePayloadCheckSum() {
     m_payloadchecksum = false;
 }
 
+void MsgPacket::attachFile(const std::shared_ptr<void>& owner, int fd, off_t offset, uint32_t length) {
+    m_fileOwner = owner;
+    m_fileDescriptor = fd;
+    m_fileOffset = offset;
+    m_fileLength = length;
+    m_payloadchecksum = false;
+}
+
+int MsgPacket::getFileDescriptor() {
+    return m_fileDescriptor;
+}
+
+off_t MsgPacket::getFileOffset() {
+    return m_fileOffset;
+}
+
+uint32_t MsgPacket::getFileLength() {
+    return m_fileLength;
+}
+
 bool MsgPacket::put_String(const std::string& string) {
     return put_String(string.c_str());
 }
@@ -360,12 +487,23 @@ void MsgPacket::freeze() {
     }
 
     writePacket<uint32_t>(PayloadCheckSumPos, htobe32(payloadCheckSum));
-    writePacket<uint32_t>(PayloadLengthPos, htobe32(m_usage - HeaderLength));
+    writePacket<uint32_t>(PayloadLengthPos, htobe32(m_usage - HeaderLength + m_fileLength));
     writePacket<uint32_t>(CheckSumPos, htobe32(crc32(m_packet, CheckSumPos)));
 
     m_freezed = true;
 }
 
+void MsgPacket::copyHeader(uint8_t* header, uint16_t protocolVersion) {
+    freeze();
+
+    uint16_t version = htobe16(protocolVersion);
+    memcpy(header, m_packet, HeaderLength);
+    memcpy(header + ProtocolVersionPos, &version, sizeof(version));
+
+    uint32_t checksum = htobe32(crc32(header, CheckSumPos));
+    memcpy(header + CheckSumPos, &checksum, sizeof(checksum));
+}
+
 bool MsgPacket::checkPacketSize(uint32_t bytes) {
     if(bytes == 0) {
         return false;
@@ -379,33 +517,32 @@ bool MsgPacket::checkPacketSize(uint32_t bytes) {
         bytes = IncrementPacketSize;
     }
 
-    uint8_t* buffer = (uint8_t*)realloc((void*)m_packet, m_usage + bytes);
+    uint32_t size = m_usage + bytes;
 
-    if(buffer == NULL) {
-        buffer = (uint8_t*)malloc(m_usage + bytes);
+    // grow unpooled packets geometrically
+    if(size > PacketPool::MaxClassSize && size < m_size + m_size / 2) {
+        size = m_size + m_size / 2;
+    }
 
-        if(buffer == NULL) {
-            return false;
-        }
+    uint32_t capacity = 0;
+    uint8_t* buffer = PacketPool::allocate(size, capacity);
+
+    if(buffer == NULL) {
+        return false;
+    }
 
+    if(m_packet != NULL) {
         memcpy(buffer, m_packet, m_usage);
-        free(m_packet);
+        PacketPool::release(m_packet, m_size);
     }
 
     m_packet = buffer;
-    m_size = m_usage + bytes;
+    m_size = capacity;
     return true;
 }
 
 uint32_t MsgPacket::crc32(const uint8_t* buf, int size) {
-    uint32_t crc = 0xFFFFFFFF;
-    const uint8_t* p = buf;
-
-    while(size--) {
-        crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
-    }
-
-    return (crc ^ ~0U);
+    return roboTV::Crc32::checksum(buf, size);
 }
 
 bool MsgPacket::write(int fd, int timeout_ms) {
@@ -534,6 +671,70 @@ MsgPacket* MsgPacket::read(int fd, bool& closed, int timeout_ms) {
     return p;
 }
 
+bool MsgPacket::checkHeader(const uint8_t* header) {
+    uint32_t value;
+
+    // check sync
+    memcpy(&value, header + SyncPos, sizeof(value));
+
+    if(be32toh(value) != 0xAAAAAA) {
+        return false;
+    }
+
+    // header validation
+    memcpy(&value, header + CheckSumPos, sizeof(value));
+
+    if(be32toh(value) != crc32(header, CheckSumPos)) {
+        std::cerr << "checksum failed !" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+MsgPacket* MsgPacket::parse(const uint8_t* data, uint32_t size) {
+    if(size < HeaderLength) {
+        return NULL;
+    }
+
+    if(!checkHeader(data)) {
+        return NULL;
+    }
+
+    uint32_t datalen;
+    memcpy(&datalen, data + PayloadLengthPos, sizeof(datalen));
+    datalen = be32toh(datalen);
+
+    if(datalen > size - HeaderLength) {
+        return NULL;
+    }
+
+    const uint8_t* payload = data + HeaderLength;
+
+    // payload checksum validation
+    uint32_t plcs;
+    memcpy(&plcs, data + PayloadCheckSumPos, sizeof(plcs));
+    plcs = be32toh(plcs);
+
+    if(plcs != 0 && plcs != crc32(payload, datalen)) {
+        std::cerr << "wrong payload checksum !" << std::endl;
+        return NULL;
+    }
+
+    MsgPacket* p = new MsgPacket(0, 0, 1, datalen);
+
+    if(p->m_packet == NULL || (datalen > 0 && p->reserve(datalen) == NULL)) {
+        delete p;
+        return NULL;
+    }
+
+    memcpy(p->m_packet, data, HeaderLength);
+    memcpy(p->m_packet + HeaderLength, payload, datalen);
+    p->m_payloadchecksum = (plcs != 0);
+
+    return p;
+}
+
 bool MsgPacket::readstream(std::istream& in, MsgPacket& p) {
     uint8_t* header = p.getPacket();
 
@@ -612,12 +813,27 @@ bool MsgPacket::readstream(std::istream& in, MsgPacket& p) {
     return true;
 }
 
-bool MsgPacket::compress(int level) {
-#ifndef HAVE_ZLIB
-    return false;
-#else
+bool MsgPacket::codecSupported(Codec codec) {
+    switch(codec) {
+#ifdef HAVE_ZLIB
+        case CodecZlib:
+            return true;
+#endif
+#ifdef HAVE_ZSTD
+        case CodecZstd:
+            return true;
+#endif
+#ifdef HAVE_LZ4
+        case CodecLz4:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
 
-    if(level <= 0 || level > 9 || m_freezed) {
+bool MsgPacket::compress(int level, Codec codec) {
+    if(level <= 0 || m_freezed || m_fileLength > 0 || !codecSupported(codec)) {
         return false;
     }
 
@@ -627,63 +843,65 @@ bool MsgPacket::compress(int level) {
         return true;
     }
 
-    uint8_t* compressed = (uint8_t*)malloc(uncompressedsize);
-    uLongf compressedsize = uncompressedsize;
-
-    if(compressed == NULL) {
-        return NULL;
-    }
+    // compress directly into a new packet buffer
+    // fails if the compressed payload isn't smaller
+    uint32_t capacity = 0;
+    uint8_t* buffer = PacketPool::allocate(HeaderLength + uncompressedsize, capacity);
 
-    if(::compress2(compressed, &compressedsize, getPayload(), uncompressedsize, level) != Z_OK) {
-        free(compressed);
+    if(buffer == NULL) {
         return false;
     }
 
-    clear();
-    uint8_t* data = reserve(compressedsize);
+    size_t compressedsize = compressData(codec, level, buffer + HeaderLength, uncompressedsize, getPayload(), uncompressedsize);
 
-    if(data == NULL) {
-        free(compressed);
+    if(compressedsize == 0) {
+        PacketPool::release(buffer, capacity);
         return false;
     }
 
-    memcpy(data, compressed, compressedsize);
-    free(compressed);
+    memcpy(buffer, m_packet, HeaderLength);
+    PacketPool::release(m_packet, m_size);
+
+    m_packet = buffer;
+    m_size = capacity;
+    m_usage = HeaderLength + compressedsize;
+    m_readposition = HeaderLength;
 
-    m_freezed = false;
     writePacket<uint32_t>(UncompressedPayloadLengthPos, htobe32(uncompressedsize));
     freeze();
 
     return true;
-#endif
 }
 
 bool MsgPacket::isCompressed() {
     return (be32toh(readPacket<uint32_t>(UncompressedPayloadLengthPos)) != 0);
 }
 
-bool MsgPacket::uncompress() {
-#ifndef HAVE_ZLIB
-    return false;
-#else
-    uLongf uncompressedsize = be32toh(readPacket<uint32_t>(UncompressedPayloadLengthPos));
-    uint8_t* uncompressed = (uint8_t*)malloc(uncompressedsize);
-
-    if(::uncompress(uncompressed, &uncompressedsize, getPayload(), getPayloadLength()) != Z_OK) {
-        free(uncompressed);
+bool MsgPacket::uncompress(Codec codec) {
+    if(!codecSupported(codec)) {
         return false;
     }
 
-    clear();
-    uint8_t* data = reserve(uncompressedsize);
+    uint32_t uncompressedsize = be32toh(readPacket<uint32_t>(UncompressedPayloadLengthPos));
+    uint32_t capacity = 0;
+    uint8_t* buffer = PacketPool::allocate(HeaderLength + uncompressedsize, capacity);
 
-    if(data == NULL) {
-        free(uncompressed);
+    if(buffer == NULL) {
         return false;
     }
 
-    memcpy(data, uncompressed, uncompressedsize);
-    free(uncompressed);
+    if(!uncompressData(codec, buffer + HeaderLength, uncompressedsize, getPayload(), getPayloadLength())) {
+        PacketPool::release(buffer, capacity);
+        return false;
+    }
+
+    memcpy(buffer, m_packet, HeaderLength);
+    PacketPool::release(m_packet, m_size);
+
+    m_packet = buffer;
+    m_size = capacity;
+    m_usage = HeaderLength + uncompressedsize;
+    m_readposition = HeaderLength;
 
     writePacket<uint32_t>(UncompressedPayloadLengthPos, htobe32(0));
 
@@ -691,7 +909,6 @@ bool MsgPacket::uncompress() {
     freeze();
 
     return true;
-#endif
 }
 
 void MsgPacket::print() {
@@ -718,8 +935,11 @@ void MsgPacket::print() {
 }
 
 MsgPacket* MsgPacket::clone() {
-    auto* p = new MsgPacket(getMsgID(), getType());
-    memcpy(p->getPayload(), getPayload(), getPayloadLength());
+    auto* p = new MsgPacket(getMsgID(), getType(), 0, getPayloadLength());
+
+    if(getPayloadLength() > 0) {
+        p->put_Blob(getPayload(), getPayloadLength());
+    }
 
     return p;
 }
\ No newline at end of file
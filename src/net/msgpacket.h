@@ -7,9 +7,11 @@
 #define MSGPACKET_H
 
 #include <stdint.h>
-#include <pthread.h>
 #include <string.h>
 #include <string>
+#include <atomic>
+#include <memory>
+#include <sys/types.h>
 
 #include <ostream>
 #include <istream>
@@ -36,6 +38,8 @@
 */
 
 class MsgPacket {
+    friend class PacketReader;
+
 public:
 
     /**
@@ -45,8 +49,9 @@ public:
     @param	msgid			user defined message id
     @param	type			user defined message type (default: 0)
     @param	uid				packet uid (default: unique incremental id)
+    @param	payloadSize		expected payload size in bytes (capacity hint)
     */
-    MsgPacket(uint16_t msgid, uint16_t type = 0, uint32_t uid = 0);
+    MsgPacket(uint16_t msgid, uint16_t type = 0, uint32_t uid = 0, uint32_t payloadSize = 0);
 
     /**
     MsgPacket constructor.
@@ -298,6 +303,17 @@ public:
     */
     void freeze();
 
+    /**
+    Copy packet header.
+    Copies the header of the frozen packet into a separate buffer and
+    stamps the given protocol version (the header checksum is recomputed).
+    The packet itself isn't modified, so it may be shared between connections.
+
+    @param	header				destination buffer (HeaderLength bytes)
+    @param	protocolVersion		protocol version to set
+    */
+    void copyHeader(uint8_t* header, uint16_t protocolVersion);
+
     /**
     Get pointer to packet data.
     Returns a pointer to the packet header data
@@ -376,6 +392,36 @@ public:
     */
     void disablePayloadCheckSum();
 
+    /**
+    Attach a file range.
+    The range is sent behind the payload straight from the file, without
+    copying it into the packet. Packets with an attached range have no
+    payload checksum and can't be compressed.
+
+    @param owner		reference keeping the range valid until the packet is deleted
+    @param fd			file descriptor
+    @param offset		start of the range
+    @param length		length of the range
+    */
+    void attachFile(const std::shared_ptr<void>& owner, int fd, off_t offset, uint32_t length);
+
+    /**
+    Get the file descriptor of the attached range.
+
+    @return file descriptor or -1 if no range is attached
+    */
+    int getFileDescriptor();
+
+    off_t getFileOffset();
+
+    /**
+    Get the length of the attached range.
+    The range isn't included in getPacketLength() and getPayloadLength()
+
+    @return length of the range
+    */
+    uint32_t getFileLength();
+
     /**
     Get protocol version.
     Return the user defined protocol version
@@ -416,14 +462,25 @@ public:
     */
     void setType(uint16_t type);
 
+    /**
+    Compression codecs.
+    The codec isn't stored in the packet, it has to be negotiated by the endpoints.
+    */
+    enum Codec {
+        CodecZlib = 0,		/*!< zlib (default) */
+        CodecLz4 = 1,		/*!< LZ4 (level is used as acceleration factor) */
+        CodecZstd = 2		/*!< Zstandard */
+    };
+
     /**
     Compress packet.
     Compress the payload of the packet
 
-    @param level compression level (1 - 9)
+    @param level compression level (1 - 9 for zlib)
+    @param codec compression codec
     @return true on success
     */
-    bool compress(int level);
+    bool compress(int level, Codec codec = CodecZlib);
 
     bool isCompressed();
 
@@ -431,9 +488,30 @@ public:
     Uncompress packet.
     Uncompress the payload of the packet
 
+    @param codec compression codec
     @return true on success
     */
-    bool uncompress();
+    bool uncompress(Codec codec = CodecZlib);
+
+    /**
+    Check codec support.
+
+    @param codec compression codec
+    @return true if the codec has been compiled in
+    */
+    static bool codecSupported(Codec codec);
+
+    /**
+    Request compression.
+    Marks the packet to be compressed before it will be sent.
+    */
+    void requestCompression() {
+        m_compressionRequested = true;
+    }
+
+    bool compressionRequested() const {
+        return m_compressionRequested;
+    }
 
     void print();
 
@@ -467,6 +545,25 @@ public:
     */
     static MsgPacket* read(int fd, bool& closed, int timeout_ms = 3000);
 
+    /**
+    Create packet from memory.
+    The buffer must start with a packet header.
+
+    @param	data	pointer to the packet data
+    @param	size	number of bytes available in the buffer
+    @return pointer to new packet or NULL if the data is incomplete or invalid
+    */
+    static MsgPacket* parse(const uint8_t* data, uint32_t size);
+
+    /**
+    Check a packet header.
+    Verifies the sync-mark and the header checksum.
+
+    @param	header	pointer to the header data (HeaderLength bytes)
+    @return true if the header is valid
+    */
+    static bool checkHeader(const uint8_t* header);
+
     static bool readstream(std::istream& in, MsgPacket& p);
 
     MsgPacket* clone();
@@ -487,7 +584,7 @@ public:
 
 protected:
 
-    void Init(uint16_t msgid, uint16_t type = 0, uint32_t uid = 0);
+    void Init(uint16_t msgid, uint16_t type = 0, uint32_t uid = 0, uint32_t payloadSize = 0);
 
     /**
     Compute a CRC32 checksum.
@@ -516,8 +613,7 @@ private:
 
     bool checkPacketSize(uint32_t bytes);
 
-    static uint32_t globalUID;
-    static uint32_t crc32_tab[];
+    static std::atomic<uint32_t> globalUID;
 
     uint8_t* m_packet;
     uint32_t m_size;
@@ -526,13 +622,17 @@ private:
 
     bool m_freezed;
     bool m_payloadchecksum;
+    bool m_compressionRequested;
+
+    std::shared_ptr<void> m_fileOwner;
+    int m_fileDescriptor;
+    off_t m_fileOffset;
+    uint32_t m_fileLength;
 
     enum {
         InitialPacketSize = 128,
         IncrementPacketSize = 512
     };
-
-    static pthread_mutex_t uidmutex;
 };
 
 inline std::ostream& operator<<(std::ostream& out, MsgPacket& p) {
@@ -583,8 +683,8 @@ class MsgPacket {
 +uint8_t* consume(uint32_t length)
 +void clear()
 .. compression ..
-+bool compress(int level)
-+bool uncompress()
++bool compress(int level, Codec codec)
++bool uncompress(Codec codec)
 .. transport ..
 +{static} MsgPacket* read(int fd, bool& closed, int timeout_ms)
 +bool write(int fd, int timeout_ms)
@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "packetpool.h"
+#include "tools/statistics.h"
+
+const uint32_t PacketPool::m_classSize[PacketPool::ClassCount] = {
+    128, 512, 2 * 1024, 8 * 1024, 32 * 1024, 64 * 1024, PacketPool::MaxClassSize
+};
+
+namespace {
+
+// number of bytes cached per size class and thread
+const size_t ThreadCacheBytes = 1024 * 1024;
+
+// number of bytes kept in the shared depot per size class
+const size_t DepotBytes = 8 * 1024 * 1024;
+
+struct Depot {
+    std::mutex mutex;
+    std::vector<uint8_t*> buffers;
+};
+
+Depot depot[PacketPool::ClassCount];
+
+size_t limit(size_t bytes, uint32_t classSize, size_t minimum) {
+    return std::max<size_t>(bytes / classSize, minimum);
+}
+
+/**
+ * Per thread buffer cache.
+ * Cached buffers are handed back to the depot when the thread exits.
+ */
+struct ThreadCache {
+    std::vector<uint8_t*> buffers[PacketPool::ClassCount];
+
+    ~ThreadCache() {
+        for(int i = 0; i < PacketPool::ClassCount; i++) {
+            std::lock_guard<std::mutex> lock(depot[i].mutex);
+            depot[i].buffers.insert(depot[i].buffers.end(), buffers[i].begin(), buffers[i].end());
+        }
+    }
+};
+
+thread_local ThreadCache cache;
+
+roboTV::Statistics::Counter& counter(const char* name) {
+    return roboTV::Statistics::instance().counter(name);
+}
+
+}
+
+int PacketPool::classIndex(uint32_t size) {
+    for(int i = 0; i < ClassCount; i++) {
+        if(size <= m_classSize[i]) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+uint32_t PacketPool::classSize(uint32_t size) {
+    int index = classIndex(size);
+    return (index == -1) ? 0 : m_classSize[index];
+}
+
+uint8_t* PacketPool::allocate(uint32_t size, uint32_t& capacity) {
+    static auto& allocPooled = counter("packet.alloc.pooled");
+    static auto& allocSystem = counter("packet.alloc.system");
+
+    int index = classIndex(size);
+
+    // not pooled
+    if(index == -1) {
+        allocSystem++;
+        capacity = size;
+        return (uint8_t*)malloc(size);
+    }
+
+    capacity = m_classSize[index];
+    std::vector<uint8_t*>& buffers = cache.buffers[index];
+
+    // refill thread cache from the depot
+    if(buffers.empty()) {
+        size_t count = limit(ThreadCacheBytes, capacity, 4) / 2;
+        std::lock_guard<std::mutex> lock(depot[index].mutex);
+        std::vector<uint8_t*>& shared = depot[index].buffers;
+
+        count = std::min(count, shared.size());
+        buffers.insert(buffers.end(), shared.end() - count, shared.end());
+        shared.resize(shared.size() - count);
+    }
+
+    if(buffers.empty()) {
+        allocSystem++;
+        return (uint8_t*)malloc(capacity);
+    }
+
+    allocPooled++;
+    uint8_t* buffer = buffers.back();
+    buffers.pop_back();
+
+    return buffer;
+}
+
+void PacketPool::release(uint8_t* buffer, uint32_t capacity) {
+    static auto& releaseSystem = counter("packet.release.system");
+
+    if(buffer == NULL) {
+        return;
+    }
+
+    int index = classIndex(capacity);
+
+    // only buffers of the exact class size have been pooled
+    if(index == -1 || m_classSize[index] != capacity) {
+        releaseSystem++;
+        free(buffer);
+        return;
+    }
+
+    std::vector<uint8_t*>& buffers = cache.buffers[index];
+    size_t cacheLimit = limit(ThreadCacheBytes, capacity, 4);
+
+    // move half of the thread cache to the depot
+    if(buffers.size() >= cacheLimit) {
+        size_t count = cacheLimit / 2;
+        size_t depotLimit = limit(DepotBytes, capacity, 16);
+
+        std::lock_guard<std::mutex> lock(depot[index].mutex);
+        std::vector<uint8_t*>& shared = depot[index].buffers;
+
+        while(count-- > 0) {
+            if(shared.size() < depotLimit) {
+                shared.push_back(buffers.back());
+            }
+            else {
+                releaseSystem++;
+                free(buffers.back());
+            }
+
+            buffers.pop_back();
+        }
+    }
+
+    buffers.push_back(buffer);
+}
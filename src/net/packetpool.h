@@ -0,0 +1,62 @@
+/** \file packetpool.h
+	Header file for the PacketPool class.
+	This include file defines the PacketPool class
+*/
+
+#ifndef PACKETPOOL_H
+#define PACKETPOOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+	@short Packet buffer pool
+
+	Size class allocator for message packet buffers. Every thread keeps a
+	small cache of free buffers per size class, so most allocations don't
+	touch the system allocator or any lock. Buffers released by a different
+	thread (e.g. a stream packet created by the receiver and freed after
+	sending) are balanced through a shared depot.
+*/
+
+class PacketPool {
+public:
+
+    /**
+    Allocate a buffer.
+
+    @param	size		minimum size of the buffer in bytes
+    @param	capacity	returns the usable size of the buffer
+    @return pointer to the buffer or NULL if memory allocation failed
+    */
+    static uint8_t* allocate(uint32_t size, uint32_t& capacity);
+
+    /**
+    Release a buffer.
+
+    @param	buffer		buffer returned by allocate()
+    @param	capacity	capacity of the buffer
+    */
+    static void release(uint8_t* buffer, uint32_t capacity);
+
+    /**
+    Get the capacity of the size class.
+
+    @param	size		requested size in bytes
+    @return capacity of the smallest class that fits or 0 if the buffer isn't pooled
+    */
+    static uint32_t classSize(uint32_t size);
+
+    enum {
+        ClassCount = 7,
+        MaxClassSize = 192 * 1024		/*!< 128 KB+ class for aggregated stream packets */
+    };
+
+private:
+
+    static int classIndex(uint32_t size);
+
+    static const uint32_t m_classSize[ClassCount];
+};
+
+#endif // PACKETPOOL_H
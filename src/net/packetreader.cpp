@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+
+#include "os-config.h"
+#include "msgpacket.h"
+#include "packetreader.h"
+
+PacketReader::PacketReader(uint32_t bufferSize) : m_size(bufferSize), m_start(0), m_end(0) {
+    m_buffer = (uint8_t*)malloc(m_size);
+
+    if(m_buffer == NULL) {
+        m_size = 0;
+    }
+}
+
+PacketReader::~PacketReader() {
+    free(m_buffer);
+}
+
+bool PacketReader::reserve(uint32_t bytes) {
+    // move remaining data to the front of the buffer
+    if(m_start > 0) {
+        memmove(m_buffer, m_buffer + m_start, m_end - m_start);
+        m_end -= m_start;
+        m_start = 0;
+    }
+
+    if(m_end + bytes <= m_size) {
+        return true;
+    }
+
+    // the buffer holds one incomplete packet at most
+    if(m_end + bytes > MaxBufferSize) {
+        return false;
+    }
+
+    uint32_t size = m_size * 2;
+
+    while(size < m_end + bytes) {
+        size *= 2;
+    }
+
+    if(size > MaxBufferSize) {
+        size = MaxBufferSize;
+    }
+
+    uint8_t* buffer = (uint8_t*)realloc(m_buffer, size);
+
+    if(buffer == NULL) {
+        return false;
+    }
+
+    m_buffer = buffer;
+    m_size = size;
+    return true;
+}
+
+int PacketReader::receive(int fd, bool& closed) {
+    int received = 0;
+    closed = false;
+
+    // leave the rest for the next call (the socket stays readable)
+    while(received < MaxReadSize) {
+        // keep some space for the next chunk
+        if(m_size - m_end < InitialBufferSize / 4 && !reserve(InitialBufferSize)) {
+            return received;
+        }
+
+        uint32_t length = std::min<uint32_t>(m_size - m_end, MaxReadSize - received);
+        int rc = recv(fd, (char*)(m_buffer + m_end), length, MSG_DONTWAIT);
+
+        if(rc == -1 && sockerror() == ENOTSOCK) {
+            rc = ::read(fd, m_buffer + m_end, length);
+        }
+
+        if(rc == 0) {
+            closed = true;
+            return received;
+        }
+
+        if(rc == -1) {
+            if(sockerror() == EINTR) {
+                continue;
+            }
+
+            if(sockerror() != SEWOULDBLOCK) {
+                closed = true;
+            }
+
+            return received;
+        }
+
+        m_end += rc;
+        received += rc;
+    }
+
+    return received;
+}
+
+bool PacketReader::append(const uint8_t* data, uint32_t length) {
+    if(m_size - m_end < length && !reserve(length)) {
+        return false;
+    }
+
+    memcpy(m_buffer + m_end, data, length);
+    m_end += length;
+
+    return true;
+}
+
+MsgPacket* PacketReader::next() {
+    while(m_end - m_start >= MsgPacket::HeaderLength) {
+        uint8_t* header = m_buffer + m_start;
+        uint32_t sync;
+
+        // try to find sync
+        memcpy(&sync, header + MsgPacket::SyncPos, sizeof(sync));
+
+        if(be32toh(sync) != 0xAAAAAA) {
+            m_start++;
+            continue;
+        }
+
+        // header validation
+        uint32_t checksum;
+        memcpy(&checksum, header + MsgPacket::CheckSumPos, sizeof(checksum));
+
+        if(be32toh(checksum) != MsgPacket::crc32(header, MsgPacket::CheckSumPos)) {
+            std::cerr << "PacketReader: header checksum failed !" << std::endl;
+            m_start++;
+            continue;
+        }
+
+        uint32_t datalen;
+        memcpy(&datalen, header + MsgPacket::PayloadLengthPos, sizeof(datalen));
+        datalen = be32toh(datalen);
+
+        if(datalen > MaxPayloadLength) {
+            std::cerr << "PacketReader: payload length " << datalen << " exceeds limit !" << std::endl;
+            m_start++;
+            continue;
+        }
+
+        // wait for the remaining payload
+        if(m_end - m_start < MsgPacket::HeaderLength + datalen) {
+            return NULL;
+        }
+
+        uint8_t* payload = header + MsgPacket::HeaderLength;
+        m_start += MsgPacket::HeaderLength + datalen;
+
+        // payload checksum validation
+        uint32_t plcs;
+        memcpy(&plcs, header + MsgPacket::PayloadCheckSumPos, sizeof(plcs));
+        plcs = be32toh(plcs);
+
+        if(plcs != 0 && plcs != MsgPacket::crc32(payload, datalen)) {
+            std::cerr << "PacketReader: wrong payload checksum !" << std::endl;
+            continue;
+        }
+
+        MsgPacket* p = new MsgPacket(0, 0, 1, datalen);
+
+        if(p->m_packet == NULL || (datalen > 0 && p->reserve(datalen) == NULL)) {
+            delete p;
+            return NULL;
+        }
+
+        memcpy(p->m_packet, header, MsgPacket::HeaderLength);
+        memcpy(p->m_packet + MsgPacket::HeaderLength, payload, datalen);
+        p->m_payloadchecksum = (plcs != 0);
+
+        // all data consumed -> reset buffer
+        if(m_start == m_end) {
+            m_start = 0;
+            m_end = 0;
+        }
+
+        return p;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,92 @@
+/** \file packetreader.h
+	Header file for the PacketReader class.
+	This include file defines the PacketReader class
+*/
+
+#ifndef PACKETREADER_H
+#define PACKETREADER_H
+
+#include <stdint.h>
+
+class MsgPacket;
+
+/**
+	@short Incremental packet framer
+
+	Collects the data received from a non-blocking socket and extracts
+	complete message packets. Partial packets are kept in the receive
+	buffer until the remaining bytes arrive.
+*/
+
+class PacketReader {
+public:
+
+    /**
+    PacketReader constructor.
+
+    @param	bufferSize		initial size of the receive buffer
+    */
+    PacketReader(uint32_t bufferSize = InitialBufferSize);
+
+    /**
+    Destructor.
+    */
+    ~PacketReader();
+
+    /**
+    Receive data from socket.
+    Reads the data that is currently available on the (non-blocking) socket,
+    at most MaxReadSize bytes per call so a single client can't monopolize
+    the caller. The remaining data is read on the next call.
+
+    @param	fd			filedescriptor of the socket
+    @param	closed		set to true if connection has been closed
+    @return number of bytes received
+    */
+    int receive(int fd, bool& closed);
+
+    /**
+    Append data.
+    Adds a block of data to the receive buffer.
+
+    @param	data		pointer to data
+    @param	length		number of bytes
+    @return true on success / false on memory allocation error
+    */
+    bool append(const uint8_t* data, uint32_t length);
+
+    /**
+    Extract packet.
+    Returns the next complete packet from the receive buffer.
+
+    @return pointer to new packet or NULL if there isn't any complete packet
+    */
+    MsgPacket* next();
+
+    /**
+    Get buffered data length.
+
+    @return number of bytes waiting in the receive buffer
+    */
+    uint32_t pending() const {
+        return m_end - m_start;
+    }
+
+    enum {
+        InitialBufferSize = 16 * 1024,
+        MaxReadSize = 4 * InitialBufferSize,
+        MaxPayloadLength = 64 * 1024 * 1024,
+        MaxBufferSize = MaxPayloadLength + 2 * InitialBufferSize
+    };
+
+private:
+
+    bool reserve(uint32_t bytes);
+
+    uint8_t* m_buffer;
+    uint32_t m_size;
+    uint32_t m_start;
+    uint32_t m_end;
+};
+
+#endif // PACKETREADER_H
@@ -27,6 +27,7 @@
 #include "packetplayer.h"
 
 #define MIN_PACKET_SIZE (128 * 1024)
+#define AGGREGATE_HEADROOM (32 * 1024)
 
 PacketPlayer::PacketPlayer(const cRecording* rec) : RecPlayer(rec->FileName()) {
     m_index = new cIndexFile(rec->FileName(), false);
@@ -142,7 +143,7 @@ MsgPacket* PacketPlayer::requestPacket() {
 
     // create payload packet
     if(m_streamPacket == nullptr) {
-        m_streamPacket = new MsgPacket();
+        m_streamPacket = new MsgPacket(0, 0, 0, MIN_PACKET_SIZE + AGGREGATE_HEADROOM);
         m_streamPacket->disablePayloadCheckSum();
     }
 
@@ -23,6 +23,7 @@
  */
 
 #include <inttypes.h>
+#include <algorithm>
 #include "recplayer.h"
 
 #ifndef O_NOATIME
@@ -35,6 +36,15 @@ RecPlayer::RecPlayer(const char* filename) : m_recordingFilename(filename) {
     m_rescanInterval = 0;
     m_totalLength = 0;
 
+#ifdef HAVE_LIBURING
+    m_ringOpen = (io_uring_queue_init(4, &m_ring, 0) == 0);
+    m_prefetchBuffer = nullptr;
+    m_prefetchSize = 0;
+    m_prefetchPosition = -1;
+    m_prefetchPending = false;
+    m_prefetchResult = 0;
+#endif
+
     scan();
     m_rescanTime.Set(0);
 }
@@ -42,6 +52,14 @@ RecPlayer::RecPlayer(const char* filename) : m_recordingFilename(filename) {
 RecPlayer::~RecPlayer() {
     cleanup();
     closeFile();
+
+#ifdef HAVE_LIBURING
+    if(m_ringOpen) {
+        io_uring_queue_exit(&m_ring);
+    }
+
+    free(m_prefetchBuffer);
+#endif
 }
 
 void RecPlayer::cleanup() {
@@ -127,6 +145,12 @@ void RecPlayer::closeFile() {
         return;
     }
 
+#ifdef HAVE_LIBURING
+    // the pending read-ahead refers to this file
+    waitPrefetch();
+    m_prefetchPosition = -1;
+#endif
+
     isyslog("file closed");
     close(m_file);
 
@@ -138,6 +162,16 @@ int64_t RecPlayer::getLengthBytes() {
     return m_totalLength;
 }
 
+int RecPlayer::segmentIndex(int64_t position) {
+    for(int i = 0; i < m_segments.Size(); i++) {
+        if((position >= m_segments[i]->start) && (position < m_segments[i]->end)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
 int RecPlayer::getBlock(unsigned char* buffer, int64_t position, int64_t amount) {
     if(position >= m_totalLength) {
         esyslog("RecPlayer: position %lu past size of %lu bytes", position, m_totalLength);
@@ -148,16 +182,33 @@ int RecPlayer::getBlock(unsigned char* buffer, int64_t position, int64_t amount)
         amount = m_totalLength - position;
     }
 
-    // work out what block "position" is in
-    int segmentNumber = -1;
+    int64_t total = 0;
 
-    for(int i = 0; i < m_segments.Size(); i++) {
-        if((position >= m_segments[i]->start) && (position < m_segments[i]->end)) {
-            segmentNumber = i;
+    // the block may span several segments
+    while(total < amount) {
+        ssize_t bytes_read = readBlock(&buffer[total], position + total, amount - total);
+
+        if(bytes_read <= 0) {
             break;
         }
+
+        total += bytes_read;
     }
 
+#ifdef HAVE_LIBURING
+    // fetch the following block while the current one is processed
+    if(total > 0) {
+        prefetch(position + total, amount);
+    }
+#endif
+
+    return (int)total;
+}
+
+ssize_t RecPlayer::readBlock(unsigned char* buffer, int64_t position, int64_t amount) {
+    // work out what block "position" is in
+    int segmentNumber = segmentIndex(position);
+
     // segment not found / invalid position
     if(segmentNumber == -1) {
         esyslog("RecPlayer: segment number for position %lu not found !", position);
@@ -173,14 +224,17 @@ int RecPlayer::getBlock(unsigned char* buffer, int64_t position, int64_t amount)
     // work out position in current file
     int64_t filePosition = position - m_segments[segmentNumber]->start;
 
-    // seek to position
-    if(lseek(m_file, filePosition, SEEK_SET) == -1) {
-        esyslog("RecPlayer: unable to seek to position: %lu", filePosition);
-        return 0;
-    }
+#ifdef HAVE_LIBURING
+    ssize_t bytes_read = readPrefetched(buffer, position, amount);
 
+    // not prefetched - try to read the block
+    if(bytes_read <= 0) {
+        bytes_read = pread(m_file, buffer, (size_t)amount, filePosition);
+    }
+#else
     // try to read the block
-    ssize_t bytes_read = read(m_file, buffer, (size_t)amount);
+    ssize_t bytes_read = pread(m_file, buffer, (size_t)amount, filePosition);
+#endif
 
     if(bytes_read <= 0) {
         esyslog("RecPlayer: read returned %lu", bytes_read);
@@ -192,10 +246,94 @@ int RecPlayer::getBlock(unsigned char* buffer, int64_t position, int64_t amount)
     posix_fadvise(m_file, filePosition, bytes_read, POSIX_FADV_DONTNEED);
 #endif
 
-    // divide and conquer
-    if(bytes_read < amount) {
-        bytes_read += getBlock(&buffer[bytes_read], position + bytes_read, amount - bytes_read);
+    return bytes_read;
+}
+
+#ifdef HAVE_LIBURING
+
+void RecPlayer::prefetch(int64_t position, int64_t amount) {
+    if(!m_ringOpen || m_prefetchPending || position >= m_totalLength) {
+        return;
     }
 
-    return (int)bytes_read;
+    // read-ahead within the open segment only
+    int segmentNumber = segmentIndex(position);
+
+    if(segmentNumber == -1 || segmentNumber != m_fileOpen) {
+        return;
+    }
+
+    amount = std::min(amount, m_segments[segmentNumber]->end - position);
+
+    if(amount > m_prefetchSize) {
+        unsigned char* buffer = (unsigned char*)realloc(m_prefetchBuffer, amount);
+
+        if(buffer == nullptr) {
+            return;
+        }
+
+        m_prefetchBuffer = buffer;
+        m_prefetchSize = amount;
+    }
+
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+
+    if(sqe == nullptr) {
+        return;
+    }
+
+    io_uring_prep_read(sqe, m_file, m_prefetchBuffer, (unsigned)amount, position - m_segments[segmentNumber]->start);
+
+    if(io_uring_submit(&m_ring) != 1) {
+        return;
+    }
+
+    m_prefetchPending = true;
+    m_prefetchPosition = position;
+}
+
+ssize_t RecPlayer::readPrefetched(unsigned char* buffer, int64_t position, int64_t amount) {
+    if(m_prefetchPosition == -1) {
+        return 0;
+    }
+
+    waitPrefetch();
+
+    // we seeked somewhere else
+    if(m_prefetchPosition != position || m_prefetchResult <= 0) {
+        m_prefetchPosition = -1;
+        return 0;
+    }
+
+    ssize_t count = std::min((int64_t)m_prefetchResult, amount);
+    memcpy(buffer, m_prefetchBuffer, count);
+
+    m_prefetchPosition = -1;
+    return count;
 }
+
+void RecPlayer::waitPrefetch() {
+    if(!m_prefetchPending) {
+        return;
+    }
+
+    struct io_uring_cqe* cqe = nullptr;
+    int rc;
+
+    do {
+        rc = io_uring_wait_cqe(&m_ring, &cqe);
+    }
+    while(rc == -EINTR);
+
+    m_prefetchPending = false;
+
+    if(rc < 0) {
+        m_prefetchResult = rc;
+        return;
+    }
+
+    m_prefetchResult = cqe->res;
+    io_uring_cqe_seen(&m_ring, cqe);
+}
+
+#endif // HAVE_LIBURING
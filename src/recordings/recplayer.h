@@ -30,6 +30,10 @@
 #include <vdr/tools.h>
 #include <vdr/recording.h>
 
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
 class Segment {
 public:
     int64_t start;
@@ -67,6 +71,34 @@ private:
 
     char* fileNameFromIndex(int index);
 
+    int segmentIndex(int64_t position);
+
+    ssize_t readBlock(unsigned char* buffer, int64_t position, int64_t amount);
+
+#ifdef HAVE_LIBURING
+
+    void prefetch(int64_t position, int64_t amount);
+
+    ssize_t readPrefetched(unsigned char* buffer, int64_t position, int64_t amount);
+
+    void waitPrefetch();
+
+    struct io_uring m_ring;
+
+    bool m_ringOpen;
+
+    unsigned char* m_prefetchBuffer;
+
+    int64_t m_prefetchSize;
+
+    int64_t m_prefetchPosition;
+
+    bool m_prefetchPending;
+
+    int m_prefetchResult;
+
+#endif
+
     char m_fileName[512];
 
     int m_file;
@@ -170,7 +170,10 @@ void StreamPacketProcessor::onStreamPacket(TsDemuxer::StreamPacket *p) {
     }
 
     // initialise stream packet
-    MsgPacket* packet = new MsgPacket(ROBOTV_STREAM_MUXPKT, ROBOTV_CHANNEL_STREAM);
+    // pid, pts, dts, duration, size, data, wallclock
+    uint32_t payloadSize = 2 + 8 + 8 + 4 + 4 + (uint32_t)p->size + 8;
+
+    MsgPacket* packet = new MsgPacket(ROBOTV_STREAM_MUXPKT, ROBOTV_CHANNEL_STREAM, 0, payloadSize);
     packet->disablePayloadCheckSum();
 
     // write stream data
@@ -167,7 +167,7 @@ MsgPacket* EpgController::processGet(MsgPacket* request) {
         }
     }
 
-    response->compress(9);
+    response->requestCompression();
 
     return response;
 }
@@ -195,7 +195,7 @@ MsgPacket* EpgController::processSearch(MsgPacket* request) {
         }
     });
 
-    response->compress(9);
+    response->requestCompression();
     return response;
 }
 
@@ -49,6 +49,11 @@ MsgPacket* LoginController::process(MsgPacket* request) {
 MsgPacket* LoginController::processLogin(MsgPacket* request) {
     m_protocolVersion = request->getProtocolVersion();
     m_compressionLevel = request->get_U8();
+
+    // the upper nibble of the compression byte selects the preferred codec
+    // (older clients only send a zlib compression level)
+    MsgPacket::Codec codec = (MsgPacket::Codec)(m_compressionLevel >> 4);
+    m_compressionCodec = MsgPacket::codecSupported(codec) ? codec : MsgPacket::CodecZlib;
     const char* clientName = request->get_String();
     m_statusInterfaceEnabled = request->get_U8();
     m_socketPriority = request->get_U8();
@@ -61,7 +66,7 @@ MsgPacket* LoginController::processLogin(MsgPacket* request) {
         setsockopt(m_socket, SOL_SOCKET, SO_PRIORITY, &m_socketPriority, sizeof(m_socketPriority));
     }
 
-    if(m_protocolVersion > ROBOTV_PROTOCOLVERSION || m_protocolVersion < 7) {
+    if(m_protocolVersion > ROBOTV_PROTOCOLVERSION || m_protocolVersion < ROBOTV_PROTOCOLVERSION_MIN) {
         esyslog("Client '%s' has unsupported protocol version '%u', terminating client", clientName, m_protocolVersion);
         m_loggedIn = false;
 
@@ -91,6 +96,11 @@ MsgPacket* LoginController::processLogin(MsgPacket* request) {
     response->put_String("roboTV VDR Server");
     response->put_String(ROBOTV_VERSION);
 
+    // acknowledge the compression codec
+    if(codec != MsgPacket::CodecZlib) {
+        response->put_U8((uint8_t)m_compressionCodec);
+    }
+
     m_loggedIn = true;
     return response;
 }
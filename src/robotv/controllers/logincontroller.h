@@ -47,6 +47,10 @@ public:
         return m_protocolVersion;
     }
 
+    MsgPacket::Codec compressionCodec() const {
+        return m_compressionCodec;
+    }
+
     bool loggedIn() const {
         return m_loggedIn;
     }
@@ -69,6 +73,8 @@ private:
 
     int m_compressionLevel = 0;
 
+    MsgPacket::Codec m_compressionCodec = MsgPacket::CodecZlib;
+
     bool m_loggedIn = false;
 
     bool m_statusInterfaceEnabled = false;
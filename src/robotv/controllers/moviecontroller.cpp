@@ -126,7 +126,7 @@ MsgPacket* MovieController::processGetFolders(MsgPacket* request) {
         response->put_String(folder);
     }
 
-    response->compress(9);
+    response->requestCompression();
     return response;
 }
 
@@ -139,7 +139,7 @@ MsgPacket* MovieController::processGetList(MsgPacket* request) {
         recordingToPacket(recording, response);
     }
 
-    response->compress(9);
+    response->requestCompression();
     return response;
 
 }
@@ -24,12 +24,16 @@
 
 #include <chrono>
 #include <tools/time.h>
+#include "config/config.h"
 #include "streamcontroller.h"
 #include "robotv/robotvclient.h"
+#include "live/livesessions.h"
 #include "tools/hash.h"
 
 StreamController::StreamController(RoboTvClient* parent) :
     m_langStreamType(StreamInfo::Type::AC3),
+    m_sessionToken(0),
+    m_requestPending(false),
     m_parent(parent) {
 }
 
@@ -37,7 +41,29 @@ StreamController::StreamController(const StreamController& orig) {
 }
 
 StreamController::~StreamController() {
-    stopStreaming();
+    // a reconnecting client can't take over the stream anymore
+    LiveSessions::instance().detach(m_sessionToken, this);
+
+    LiveStreamer* streamer = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        delete m_pendingResponse;
+        streamer = m_streamer;
+        m_streamer = NULL;
+    }
+
+    if(streamer == nullptr) {
+        return;
+    }
+
+    // the connection is gone, keep the stream for a reconnect
+    streamer->detach();
+
+    if(!LiveSessions::instance().park(m_sessionToken, streamer)) {
+        delete streamer;
+    }
 }
 
 MsgPacket* StreamController::process(MsgPacket* request) {
@@ -61,6 +87,12 @@ MsgPacket* StreamController::process(MsgPacket* request) {
 
         case ROBOTV_CHANNELSTREAM_SEEK:
             return processSeek(request);
+
+        case ROBOTV_CHANNELSTREAM_CREDIT:
+            return processCredit(request);
+
+        case ROBOTV_CHANNELSTREAM_RESUME:
+            return processResume(request);
     }
 
     return nullptr;
@@ -88,6 +120,13 @@ MsgPacket* StreamController::processOpen(MsgPacket* request) {
         m_langStreamType = StreamInfo::Type::AC3;
     }
 
+    // push mode credit window (0 = client pulls packets)
+    m_pushCredits = 0;
+
+    if(!request->eop()) {
+        m_pushCredits = request->get_U32();
+    }
+
     isyslog("======================================");
     isyslog("CHANNEL STREAM REQUEST");
     isyslog("======================================");
@@ -121,6 +160,10 @@ MsgPacket* StreamController::processOpen(MsgPacket* request) {
     if(status == ROBOTV_RET_OK) {
         isyslog("--------------------------------------");
         isyslog("Started streaming of channel %s (priority %i)", channel->Name(), priority);
+
+        if(m_pushCredits > 0) {
+            isyslog("Push mode enabled (%u credits)", m_pushCredits);
+        }
     }
     else {
         time_t now = time(nullptr);
@@ -135,6 +178,22 @@ MsgPacket* StreamController::processOpen(MsgPacket* request) {
     }
 
     response->put_U32((uint32_t)status);
+
+    // confirm push mode
+    if(m_pushCredits > 0) {
+        response->put_U32(m_pushCredits);
+    }
+
+    // session token for reconnects
+    if(m_parent->protocolVersion() >= 11) {
+        m_sessionToken = (status == ROBOTV_RET_OK) ? LiveSessions::instance().createToken() : 0;
+        response->put_U64(m_sessionToken);
+
+        LiveSessions::instance().attach(m_sessionToken, this, [this]() {
+            return takeOver();
+        });
+    }
+
     return response;
 }
 
@@ -144,27 +203,54 @@ MsgPacket* StreamController::processClose(MsgPacket* request) {
 }
 
 MsgPacket* StreamController::processRequest(MsgPacket* request) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
     if(m_streamer == nullptr) {
         return nullptr;
     }
 
-    MsgPacket* p = nullptr;
+    // a new request supersedes the waiting one
+    completeRequest(nullptr);
+
+    // enable notifications first, so we can't miss a write in between
+    m_streamer->setWaiting(true);
+    MsgPacket* p = m_streamer->requestPacket();
 
-    int64_t start = roboTV::currentTimeMillis().count();
+    if(p != nullptr) {
+        m_streamer->setWaiting(false);
+        return createResponse(request, p);
+    }
 
-    while(p == nullptr && (roboTV::currentTimeMillis().count() - start) < 500) {
-        p = m_streamer->requestPacket();
+    // don't block the worker, the request is answered by pushPackets()
+    // as soon as there are packets or the request timed out
+    m_pendingResponse = createResponse(request);
+    m_requestDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(REQUEST_TIMEOUT);
+    m_requestPending = true;
 
-        if(p == nullptr) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(20));
-        }
+    return nullptr;
+}
+
+void StreamController::completeRequest(MsgPacket* p) {
+    if(m_pendingResponse == nullptr) {
+        delete p;
+        return;
+    }
+
+    MsgPacket* response = m_pendingResponse;
+
+    if(p != nullptr) {
+        response = createResponse(m_pendingResponse, p);
+        delete m_pendingResponse;
     }
 
-    if(p == nullptr) {
-        return createResponse(request);
+    m_pendingResponse = nullptr;
+    m_requestPending = false;
+
+    if(m_streamer != nullptr) {
+        m_streamer->setWaiting(false);
     }
 
-    return createResponse(request, p);
+    m_parent->queueMessage(response);
 }
 
 MsgPacket* StreamController::processPause(MsgPacket* request) {
@@ -195,20 +281,48 @@ void StreamController::processChannelChange(const cChannel* Channel) {
     }
 }
 
+void StreamController::pushPackets() {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if(m_streamer == nullptr) {
+        return;
+    }
+
+    m_streamer->pushPackets();
+
+    if(m_pendingResponse == nullptr) {
+        return;
+    }
+
+    MsgPacket* p = m_streamer->requestPacket();
+
+    if(p != nullptr || std::chrono::steady_clock::now() >= m_requestDeadline) {
+        completeRequest(p);
+    }
+}
+
 int StreamController::startStreaming(const cChannel* channel, int32_t priority) {
     std::lock_guard<std::mutex> lock(m_lock);
 
     m_streamer = new LiveStreamer(m_parent, priority);
     m_streamer->setLanguage(m_language.c_str(), m_langStreamType);
+    m_streamer->enablePush(m_pushCredits);
 
     return m_streamer->switchChannel(channel);
 }
 
 void StreamController::stopStreaming() {
+    // the session lock is taken before ours
+    LiveSessions::instance().detach(m_sessionToken, this);
+
     std::lock_guard<std::mutex> lock(m_lock);
 
+    // answer a waiting request before the stream is gone
+    completeRequest(nullptr);
+
     delete m_streamer;
     m_streamer = NULL;
+    m_sessionToken = 0;
 }
 
 MsgPacket* StreamController::processSeek(MsgPacket* request) {
@@ -225,3 +339,80 @@ MsgPacket* StreamController::processSeek(MsgPacket* request) {
     response->put_S64(pts);
     return response;
 }
+
+MsgPacket* StreamController::processCredit(MsgPacket* request) {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if(m_streamer == nullptr) {
+        return nullptr;
+    }
+
+    m_streamer->addCredits(request->get_U32());
+    return nullptr;
+}
+
+MsgPacket* StreamController::processResume(MsgPacket* request) {
+    uint64_t token = request->get_U64();
+    uint32_t credits = 0;
+
+    // push mode credit window of the new connection
+    if(!request->eop()) {
+        credits = request->get_U32();
+    }
+
+    stopStreaming();
+
+    MsgPacket* response = createResponse(request);
+    LiveStreamer* streamer = LiveSessions::instance().resume(token);
+
+    if(streamer == nullptr) {
+        esyslog("unknown or expired live session %016llx", (unsigned long long)token);
+        response->put_U32(ROBOTV_RET_DATAINVALID);
+        return response;
+    }
+
+    streamer->attach(m_parent, credits);
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_streamer = streamer;
+        m_sessionToken = token;
+        m_pushCredits = credits;
+    }
+
+    LiveSessions::instance().attach(token, this, [this]() {
+        return takeOver();
+    });
+
+    isyslog("Resumed live session %016llx", (unsigned long long)token);
+    response->put_U32(ROBOTV_RET_OK);
+
+    // confirm push mode
+    if(credits > 0) {
+        response->put_U32(credits);
+    }
+
+    return response;
+}
+
+LiveStreamer* StreamController::takeOver() {
+    // called by a reconnected client (with the session lock held)
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if(m_streamer == nullptr) {
+        return nullptr;
+    }
+
+    // the request of the stale connection won't be answered anymore
+    delete m_pendingResponse;
+    m_pendingResponse = nullptr;
+    m_requestPending = false;
+
+    LiveStreamer* streamer = m_streamer;
+    streamer->detach();
+
+    m_streamer = NULL;
+    m_sessionToken = 0;
+
+    return streamer;
+}
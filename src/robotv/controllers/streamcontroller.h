@@ -25,6 +25,8 @@
 #ifndef ROBOTV_STREAMCONTROLLER_H
 #define	ROBOTV_STREAMCONTROLLER_H
 
+#include <atomic>
+#include <chrono>
 #include <mutex>
 
 #include "live/livestreamer.h"
@@ -44,6 +46,17 @@ public:
 
     void processChannelChange(const cChannel* Channel);
 
+    /**
+     * Push the available packets (client worker).
+     * Also answers a waiting stream request once packets are
+     * available or the request timed out.
+     */
+    void pushPackets();
+
+    bool requestPending() const {
+        return m_requestPending;
+    }
+
 protected:
 
     MsgPacket* processOpen(MsgPacket* request);
@@ -58,6 +71,10 @@ protected:
 
     MsgPacket* processSeek(MsgPacket* request);
 
+    MsgPacket* processCredit(MsgPacket* request);
+
+    MsgPacket* processResume(MsgPacket* request);
+
 private:
 
     StreamController(const StreamController& orig);
@@ -66,12 +83,28 @@ private:
 
     void stopStreaming();
 
+    void completeRequest(MsgPacket* p);
+
+    LiveStreamer* takeOver();
+
     std::string m_language;
 
     StreamInfo::Type m_langStreamType;
 
+    uint32_t m_pushCredits = 0;
+
+    // token to resume the stream after a lost connection (0 = none)
+    std::atomic<uint64_t> m_sessionToken;
+
     LiveStreamer* m_streamer = NULL;
 
+    // response of the stream request waiting for packets
+    MsgPacket* m_pendingResponse = NULL;
+
+    std::chrono::steady_clock::time_point m_requestDeadline;
+
+    std::atomic<bool> m_requestPending;
+
     std::mutex m_lock;
 
     RoboTvClient* m_parent;
@@ -296,7 +296,7 @@ MsgPacket* TimerController::processGetSearchTimers(MsgPacket* request) {
 
     delete service;
 
-    response->compress(9);
+    response->requestCompression();
     return response;
 }
 
@@ -25,6 +25,8 @@
 #include <getopt.h>
 #include <vdr/plugin.h>
 #include "robotv.h"
+#include "live/livequeue.h"
+#include "live/livesessions.h"
 
 PluginRoboTVServer::PluginRoboTVServer(void) {
     m_server = NULL;
@@ -66,6 +68,7 @@ bool PluginRoboTVServer::Initialize(void) {
 }
 
 bool PluginRoboTVServer::Start(void) {
+    LiveQueue::startFilePool();
     m_server = new RoboTVServer(RoboTVServerConfig::instance().listenPort);
 
     return true;
@@ -74,6 +77,10 @@ bool PluginRoboTVServer::Start(void) {
 void PluginRoboTVServer::Stop(void) {
     delete m_server;
     m_server = NULL;
+
+    LiveSessions::instance().clear();
+
+    LiveQueue::stopFilePool();
 }
 
 void PluginRoboTVServer::Housekeeping(void) {
@@ -116,6 +123,12 @@ const char** PluginRoboTVServer::SVDRPHelpPages(void) {
         "    List all channels activated for roboTV in JSON format.",
         "LSEJ channelUid | channelNumber\n"
         "    List upcoming EPG entries of the channel.",
+        "STAT\n"
+        "    Show runtime statistics in JSON format.",
+        "TSHF\n"
+        "    Show the timeshift buffer allocations in JSON format.",
+        "TSWR\n"
+        "    Show the backlog of the timeshift writers in JSON format.",
         NULL
     };
 
@@ -124,7 +137,13 @@ const char** PluginRoboTVServer::SVDRPHelpPages(void) {
 
 cString PluginRoboTVServer::SVDRPCommand(const char* Command, const char* Option, int& ReplyCode) {
     // Process SVDRP commands this plugin implements
-    return m_channels.SVDRPCommand(Command, Option, ReplyCode);
+    cString reply = m_channels.SVDRPCommand(Command, Option, ReplyCode);
+
+    if(ReplyCode != 500) {
+        return reply;
+    }
+
+    return m_status.SVDRPCommand(Command, Option, ReplyCode);
 }
 
 VDRPLUGINCREATOR(PluginRoboTVServer); // Don't touch this!
@@ -25,6 +25,7 @@
 #include <getopt.h>
 #include <vdr/plugin.h>
 #include "svdrp/channelcmds.h"
+#include "svdrp/statuscmds.h"
 
 #include "robotvserver.h"
 
@@ -38,6 +39,8 @@ private:
 
     ChannelCmds m_channels;
 
+    StatusCmds m_status;
+
 public:
 
     PluginRoboTVServer(void);
@@ -23,8 +23,14 @@
  */
 
 #include <stdlib.h>
+#include <errno.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#include <algorithm>
 #include <map>
 
 #include <vdr/recording.h>
@@ -35,8 +41,12 @@
 #include "robotvcommand.h"
 #include "robotvclient.h"
 #include "robotvserver.h"
+#include "config/config.h"
+#include "tools/statistics.h"
 
-RoboTvClient::RoboTvClient(int fd, unsigned int id) : m_id(id), m_socket(fd),
+RoboTvClient::RoboTvClient(RoboTVServer* server, int fd, unsigned int id) : m_server(server), m_id(id), m_socket(fd),
+    m_closed(false),
+    m_pushPending(false),
     m_streamController(this),
     m_recordingController(this),
     m_timerController(this) {
@@ -53,162 +63,271 @@ RoboTvClient::RoboTvClient(int fd, unsigned int id) : m_id(id), m_socket(fd),
     };
 
     m_loginController.setSocket(m_socket);
-    Start();
 }
 
 RoboTvClient::~RoboTvClient() {
     // shutdown connection
     shutdown(m_socket, SHUT_RDWR);
-    Cancel(10);
 
     // close connection
-    close(m_socket);
+    ::close(m_socket);
 
-    // delete messagequeue
+    // delete pending requests
     {
-        std::lock_guard<std::mutex> lock(m_queueLock);
+        std::lock_guard<std::mutex> lock(m_requestLock);
 
-        while(!m_queue.empty()) {
-            MsgPacket* p = m_queue.front();
-            m_queue.pop_front();
+        while(!m_requests.empty()) {
+            MsgPacket* p = m_requests.front();
+            m_requests.pop_front();
             delete p;
         }
     }
 
+    // delete messagequeue
+    {
+        std::lock_guard<std::mutex> lock(m_queueLock);
+        m_queue.clear();
+    }
+
     dsyslog("done");
 }
 
-void RoboTvClient::Action(void) {
+bool RoboTvClient::receive() {
     bool bClosed(false);
+    m_reader.receive(m_socket, bClosed);
 
-    while(Running()) {
-
-        // send pending messages
-        {
-            std::lock_guard<std::mutex> lock(m_queueLock);
+    std::lock_guard<std::mutex> lock(m_requestLock);
+    MsgPacket* p = NULL;
 
-            while(!m_queue.empty()) {
-                MsgPacket* p = m_queue.front();
+    while((p = m_reader.next()) != NULL) {
+        m_requests.push_back(p);
+    }
 
-                if(!p->write(m_socket, m_timeout)) {
-                    break;
-                }
+    return !bClosed;
+}
 
-                m_queue.pop_front();
-                delete p;
-            }
+void RoboTvClient::processRequests() {
+    while(!m_closed) {
+        // deliver the stream packets written since the last push
+        if(m_pushPending.exchange(false)) {
+            m_streamController.pushPackets();
         }
 
-        m_request = MsgPacket::read(m_socket, bClosed, 10);
+        {
+            std::lock_guard<std::mutex> lock(m_requestLock);
 
-        if(bClosed) {
-            delete m_request;
-            m_request = NULL;
-            break;
-        }
+            if(m_requests.empty()) {
+                return;
+            }
 
-        if(m_request != NULL) {
-            processRequest();
-            delete m_request;
+            m_request = m_requests.front();
+            m_requests.pop_front();
         }
+
+        processRequest();
+        delete m_request;
+        m_request = NULL;
     }
 }
 
-void RoboTvClient::Recording(const cDevice* Device, const char* Name, const char* FileName, bool On) {
-    // check if we should ignore this notification
-    if(!m_loginController.statusEnabled()) {
-        return;
+size_t RoboTvClient::pendingRequests() {
+    std::lock_guard<std::mutex> lock(m_requestLock);
+    return m_requests.size();
+}
+
+void RoboTvClient::requestPush() {
+    if(!m_pushPending.exchange(true)) {
+        m_server->notifyPush(m_socket);
     }
+}
+
+bool RoboTvClient::flush() {
+    static auto& sendCalls = roboTV::Statistics::instance().counter("client.send.syscalls");
+    static auto& sendCallsSaved = roboTV::Statistics::instance().counter("client.send.syscallsSaved");
+    static auto& sendFileBytes = roboTV::Statistics::instance().counter("client.send.sendfileBytes");
+
+    std::lock_guard<std::mutex> lock(m_queueLock);
+    struct iovec iov[MAX_SEND_IOV];
+
+    while(!m_queue.empty()) {
+        // continue with the attached file range of a packet
+        // (the header and the payload have been sent)
+        QueueEntry& front = m_queue.front();
+        uint32_t packetLength = front.packet->getPacketLength();
+
+        if(front.ready && front.packet->getFileLength() > 0 && m_sendOffset >= packetLength) {
+            ssize_t rc = sendFile(front.packet.get(), m_sendOffset - packetLength);
 
-    std::string fileName = (FileName == nullptr) ? "": FileName;
-    std::string name = (Name == nullptr) ? "" : Name;
+            if(rc == -1) {
+                if(errno == EINTR) {
+                    continue;
+                }
 
-    isyslog("----------------------------------");
-    isyslog("RECORDINGEVENT:");
-    isyslog("Client ID: %i", getId());
-    isyslog("Filename:  %s", fileName.c_str());
-    isyslog("Name:      %s", name.c_str());
-    isyslog("Recording: %s", On ? "Yes" : "No");
-    isyslog("----------------------------------");
+                if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true;
+                }
 
-    // execute in thread to prevent invalid locking
-    std::thread t([this, fileName, On]() {
-        LOCK_RECORDINGS_READ;
+                return false;
+            }
 
-        auto r = Recordings->GetByName(fileName.c_str());
+            // the file is shorter than the range
+            if(rc == 0) {
+                esyslog("unable to send file range to client %u", m_id);
+                return false;
+            }
 
-        if(r != nullptr) {
-            const cRecordingInfo* info = r->Info();
+            sendCalls++;
+            sendFileBytes += rc;
+            m_sendOffset += rc;
 
-            if(info != nullptr) {
-                const cEvent* e = info->GetEvent();
-                onRecording(e, On);
+            // socket buffer full
+            if(m_sendOffset < packetLength + front.packet->getFileLength()) {
+                return true;
             }
+
+            m_queue.pop_front();
+            m_sendOffset = 0;
+            continue;
         }
 
-        // also request timers update on recording change (the status of the
-        // timer changes)
+        // gather header and payload of the queued packets
+        // (continue a partially sent packet)
+        int count = 0;
+        size_t length = 0;
+        uint32_t offset = m_sendOffset;
 
-        MsgPacket* resp = new MsgPacket(ROBOTV_STATUS_TIMERCHANGE, ROBOTV_CHANNEL_STATUS);
-        resp->setProtocolVersion(m_loginController.protocolVersion());
+        for(auto i = m_queue.begin(); i != m_queue.end() && count + 2 <= MAX_SEND_IOV; i++) {
+            QueueEntry& e = *i;
 
-        queueMessage(resp);
-    });
-    t.join();
-}
+            if(!e.ready) {
+                if(e.stamp) {
+                    e.packet->copyHeader(e.header, protocolVersion());
+                }
+                else {
+                    e.packet->freeze();
+                    memcpy(e.header, e.packet->getPacket(), MsgPacket::HeaderLength);
+                }
 
-void RoboTvClient::TimerChange(const cTimer* Timer, eTimerChange Change) {
-    // ignore invalid timers
-    if(Timer == NULL || !m_loginController.statusEnabled()) {
-        return;
-    }
+                e.ready = true;
+            }
+
+            if(offset < MsgPacket::HeaderLength) {
+                iov[count].iov_base = e.header + offset;
+                iov[count].iov_len = MsgPacket::HeaderLength - offset;
+                length += iov[count++].iov_len;
+                offset = 0;
+            }
+            else {
+                offset -= MsgPacket::HeaderLength;
+            }
+
+            uint32_t payloadLength = e.packet->getPayloadLength();
+
+            if(offset < payloadLength) {
+                iov[count].iov_base = e.packet->getPayload() + offset;
+                iov[count].iov_len = payloadLength - offset;
+                length += iov[count++].iov_len;
+            }
+
+            offset = 0;
+
+            // the file range is sent separately
+            if(e.packet->getFileLength() > 0) {
+                break;
+            }
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        ssize_t rc = sendmsg(m_socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if(rc == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            // socket buffer full -> wait for the next write notification
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
 
-    isyslog("Sending timer change request to client #%i ...", m_id);
-    MsgPacket* resp = new MsgPacket(ROBOTV_STATUS_TIMERCHANGE, ROBOTV_CHANNEL_STATUS);
-    resp->setProtocolVersion(m_loginController.protocolVersion());
+            return false;
+        }
+
+        sendCalls++;
+
+        // remove all completely sent packets
+        size_t written = rc;
+        int completed = 0;
+
+        while(written > 0) {
+            QueueEntry& e = m_queue.front();
+            uint32_t remaining = e.packet->getPacketLength() + e.packet->getFileLength() - m_sendOffset;
+
+            if(written < remaining) {
+                m_sendOffset += written;
+                break;
+            }
+
+            written -= remaining;
+            m_queue.pop_front();
+            m_sendOffset = 0;
+            completed++;
+        }
+
+        if(completed > 1) {
+            sendCallsSaved += completed - 1;
+        }
 
-    if(Change == tcAdd) {
-        TimerController::timer2Packet(Timer, resp);
+        // socket buffer full
+        if((size_t)rc < length) {
+            return true;
+        }
     }
 
-    queueMessage(resp);
+    return true;
 }
 
-void RoboTvClient::ChannelChange(const cChannel* Channel) {
-    if(!Running()) {
-        return;
-    }
+ssize_t RoboTvClient::sendFile(MsgPacket* p, uint32_t offset) {
+    size_t length = p->getFileLength() - offset;
+    off_t position = p->getFileOffset() + offset;
 
-    m_streamController.processChannelChange(Channel);
+#ifdef __linux__
+    return sendfile(m_socket, p->getFileDescriptor(), &position, length);
+#else
+    uint8_t buffer[16 * 1024];
+    ssize_t rc = pread(p->getFileDescriptor(), buffer, std::min(length, sizeof(buffer)), position);
 
-    if(!m_loginController.statusEnabled()) {
-        return;
+    if(rc <= 0) {
+        if(rc == 0) {
+            errno = EIO;
+        }
+
+        return -1;
     }
 
-    MsgPacket* resp = new MsgPacket(ROBOTV_STATUS_CHANNELCHANGED, ROBOTV_CHANNEL_STATUS);
-    m_channelController.addChannelToPacket(Channel, resp);
+    return send(m_socket, buffer, rc, MSG_DONTWAIT | MSG_NOSIGNAL);
+#endif
+}
 
-    queueMessage(resp);
+bool RoboTvClient::hasPendingOutput() {
+    std::lock_guard<std::mutex> lock(m_queueLock);
+    return !m_queue.empty();
 }
 
-void RoboTvClient::onRecording(const cEvent* event, bool on) {
-    if(event == nullptr) {
+void RoboTvClient::close() {
+    m_closed = true;
+}
+
+void RoboTvClient::ChannelChange(const cChannel* Channel) {
+    if(m_closed) {
         return;
     }
 
-    MsgPacket* resp = new MsgPacket(ROBOTV_STATUS_RECORDING, ROBOTV_CHANNEL_STATUS);
-    resp->setProtocolVersion(m_loginController.protocolVersion());
-
-    const char* title = event->Title();
-    const char* desc = event->Description();
-
-    resp->put_U32((uint32_t)event->Index());
-    resp->put_U32(on ? 1 : 0);
-    resp->put_String(m_toUtf8.convert(title != nullptr ? title : ""));
-    resp->put_String(m_toUtf8.convert(desc != nullptr ? desc : ""));
-
-    TimerController::event2Packet(event, resp);
-    queueMessage(resp);
+    m_streamController.processChannelChange(Channel);
 }
 
 void RoboTvClient::sendStatusMessage(const char* Message) {
@@ -233,6 +352,11 @@ bool RoboTvClient::processRequest() {
     for(auto i : m_controllers) {
         MsgPacket* response = i->process(m_request);
         if(response != nullptr){
+            // compress outside of the controller (and its VDR locks)
+            if(response->compressionRequested()) {
+                compressResponse(response);
+            }
+
             queueMessage(response);
             return true;
         }
@@ -241,15 +365,57 @@ bool RoboTvClient::processRequest() {
     return false;
 }
 
+void RoboTvClient::compressResponse(MsgPacket* p) {
+    static auto& bytesIn = roboTV::Statistics::instance().counter("client.compress.bytesIn");
+    static auto& bytesOut = roboTV::Statistics::instance().counter("client.compress.bytesOut");
+
+    uint32_t size = p->getPayloadLength();
+
+    if(size < MIN_COMPRESS_SIZE) {
+        return;
+    }
+
+    MsgPacket::Codec codec = m_loginController.compressionCodec();
+    int level = compressionLevel(codec, size);
+
+    if(p->compress(level, codec)) {
+        bytesIn += size;
+        bytesOut += p->getPayloadLength();
+    }
+}
+
+int RoboTvClient::compressionLevel(MsgPacket::Codec codec, uint32_t size) {
+    // trade compression ratio for speed on large payloads
+    switch(codec) {
+        case MsgPacket::CodecZstd:
+            return (size < 64 * 1024) ? 9 : (size < 1024 * 1024) ? 5 : 1;
+
+        case MsgPacket::CodecLz4:
+            // acceleration factor
+            return (size < 1024 * 1024) ? 1 : 4;
+
+        default:
+            return (size < 64 * 1024) ? 9 : (size < 1024 * 1024) ? 6 : 3;
+    }
+}
+
+void RoboTvClient::queueEntry(const std::shared_ptr<MsgPacket>& p, bool stamp) {
+    {
+        std::lock_guard<std::mutex> lock(m_queueLock);
+        m_queue.push_back({ p, stamp, false });
+    }
+
+    m_server->notifyWrite(m_socket);
+}
+
 void RoboTvClient::queueMessage(MsgPacket* p) {
-    std::lock_guard<std::mutex> lock(m_queueLock);
-    m_queue.push_back(p);
+    queueEntry(std::shared_ptr<MsgPacket>(p), false);
 }
 
-void RoboTvClient::broadcastMessage(MsgPacket* p) {
+void RoboTvClient::broadcastMessage(const std::shared_ptr<MsgPacket>& p) {
     if(!m_loginController.statusEnabled()) {
         return;
     }
 
-    queueMessage(p->clone());
+    queueEntry(p, true);
 }
@@ -30,6 +30,8 @@
 #include <deque>
 #include <map>
 #include <thread>
+#include <atomic>
+#include <memory>
 
 #include <vdr/tools.h>
 #include <vdr/receiver.h>
@@ -37,6 +39,7 @@
 
 #include "robotvdmx/streaminfo.h"
 #include "net/msgpacket.h"
+#include "net/packetreader.h"
 #include "recordings/artwork.h"
 
 #include "controllers/streamcontroller.h"
@@ -51,24 +54,42 @@
 class cChannel;
 class cDevice;
 class PacketPlayer;
+class RoboTVServer;
 
-class RoboTvClient : public cThread, public cStatus {
+class RoboTvClient : public cStatus {
 private:
 
+    struct QueueEntry {
+        std::shared_ptr<MsgPacket> packet;
+        bool stamp;
+        bool ready;
+        uint8_t header[MsgPacket::HeaderLength];
+    };
+
+    RoboTVServer* m_server;
+
     unsigned int m_id;
 
     int m_socket;
 
+    std::atomic<bool> m_closed;
+
+    std::atomic<bool> m_pushPending;
+
     MsgPacket* m_request = NULL;
 
-    Utf8Conv m_toUtf8;
+    PacketReader m_reader;
+
+    std::deque<MsgPacket*> m_requests;
 
-    int m_timeout = 3000;
+    std::mutex m_requestLock;
 
-    std::deque<MsgPacket*> m_queue;
+    std::deque<QueueEntry> m_queue;
 
     std::mutex m_queueLock;
 
+    uint32_t m_sendOffset = 0;
+
     // Controllers
 
     StreamController m_streamController;
@@ -93,23 +114,88 @@ protected:
 
     bool processRequest();
 
-    virtual void Action(void);
+    void queueEntry(const std::shared_ptr<MsgPacket>& p, bool stamp);
+
+    void compressResponse(MsgPacket* p);
+
+    ssize_t sendFile(MsgPacket* p, uint32_t offset);
+
+    static int compressionLevel(MsgPacket::Codec codec, uint32_t size);
 
-    virtual void Recording(const cDevice* Device, const char* Name, const char* FileName, bool On);
-    virtual void TimerChange(const cTimer* Timer, eTimerChange Change);
     virtual void ChannelChange(const cChannel* Channel);
 
 public:
 
-    RoboTvClient(int fd, unsigned int id);
+    RoboTvClient(RoboTVServer* server, int fd, unsigned int id);
 
     virtual ~RoboTvClient();
 
-    void onRecording(const cEvent* event, bool on);
+    /**
+     * Receive pending data.
+     * Reads all available data from the socket and queues complete requests.
+     * Called on the server thread whenever the socket became readable.
+     * @return false if the connection has been closed
+     */
+    bool receive();
+
+    /**
+     * Process all queued requests in order.
+     * Called on a worker thread.
+     */
+    void processRequests();
+
+    size_t pendingRequests();
+
+    /**
+     * Request a push of new stream packets (any thread).
+     * The packets are pushed by the worker processing the requests.
+     */
+    void requestPush();
+
+    bool pushPending() const {
+        return m_pushPending;
+    }
+
+    /**
+     * Check if a stream request waits for packets.
+     * @return true if the request has to be answered
+     */
+    bool streamRequestPending() const {
+        return m_streamController.requestPending();
+    }
+
+    /**
+     * Send pending messages.
+     * Writes as much of the message queue as the socket accepts without blocking.
+     * @return false if the connection failed
+     */
+    bool flush();
+
+    bool hasPendingOutput();
+
+    void close();
+
+    bool closed() const {
+        return m_closed;
+    }
 
     void queueMessage(MsgPacket* p);
 
-    void broadcastMessage(MsgPacket* p);
+    /**
+     * Queue a shared status packet.
+     * The packet must not be modified anymore. The protocol version of the
+     * client is stamped into a copy of the header when the packet is sent.
+     * @param p shared packet
+     */
+    void broadcastMessage(const std::shared_ptr<MsgPacket>& p);
+
+    bool statusEnabled() const {
+        return m_loginController.statusEnabled();
+    }
+
+    uint16_t protocolVersion() const {
+        return m_loginController.protocolVersion();
+    }
 
     void sendStatusMessage(const char* Message);
 
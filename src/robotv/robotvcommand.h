@@ -26,7 +26,10 @@
 #define ROBOTV_COMMAND_H
 
 /** Current RoboTV Protocol Version number */
-#define ROBOTV_PROTOCOLVERSION          9
+#define ROBOTV_PROTOCOLVERSION          11
+
+/** Oldest supported RoboTV Protocol Version number */
+#define ROBOTV_PROTOCOLVERSION_MIN      7
 
 
 /** Packet types */
@@ -53,6 +56,10 @@
 #define ROBOTV_CHANNELSTREAM_PAUSE   23
 #define ROBOTV_CHANNELSTREAM_SIGNAL  24
 #define ROBOTV_CHANNELSTREAM_SEEK    25
+#define ROBOTV_CHANNELSTREAM_CREDIT  26
+
+/** Resume the live stream of a lost connection (protocol version 11) */
+#define ROBOTV_CHANNELSTREAM_RESUME  27
 
 /* OPCODE 40 - 59: RoboTV network functions for recording streaming */
 #define ROBOTV_RECSTREAM_OPEN        40
@@ -116,10 +123,15 @@
 #define ROBOTV_STREAM_SIGNALINFO   5
 #define ROBOTV_STREAM_DETACH       7
 #define ROBOTV_STREAM_POSITIONS    8
+#define ROBOTV_STREAM_PACKETS      9
+
+/** Aggregate of length-prefixed stream packets (protocol version 10) */
+#define ROBOTV_STREAM_RECORDS      10
 
 /** Stream status codes */
 #define ROBOTV_STREAM_STATUS_SIGNALLOST     111
 #define ROBOTV_STREAM_STATUS_SIGNALRESTORED 112
+#define ROBOTV_STREAM_STATUS_CATCHUP        113
 
 /** Status packet types (server -> client) */
 #define ROBOTV_STATUS_TIMERCHANGE      1
@@ -35,6 +35,8 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include <vdr/plugin.h>
 #include <vdr/shutdown.h>
@@ -47,7 +49,7 @@
 #include "tools/hash.h"
 
 unsigned int RoboTVServer::m_idCnt = 0;
-std::deque<MsgPacket*> RoboTVServer::m_broadcast;
+std::deque<RoboTVServer::StatusPacket> RoboTVServer::m_broadcast;
 std::mutex RoboTVServer::m_broadcastLock;
 
 class cAllowedHosts : public cSVDRPhosts {
@@ -74,6 +76,9 @@ public:
 RoboTVServer::RoboTVServer(int listenPort) : cThread("roboTV VDR Server"), m_config(RoboTVServerConfig::instance()) {
     m_ipv4Fallback = false;
     m_serverPort  = listenPort;
+    m_epollFd = -1;
+    m_wakeupFd = -1;
+    m_workers = nullptr;
 
     if(!m_config.configDirectory.empty()) {
         m_allowedHostsFile = cString::sprintf("%s/" ALLOWED_HOSTS_FILE, m_config.configDirectory.c_str());
@@ -131,6 +136,28 @@ RoboTVServer::RoboTVServer(int listenPort) : cThread("roboTV VDR Server"), m_con
         return;
     }
 
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if(m_epollFd == -1 || m_wakeupFd == -1) {
+        esyslog("RoboTVServer: unable to create event loop (errno=%d: %s)", errno, strerror(errno));
+        return;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+
+    ev.events = EPOLLIN;
+    ev.data.fd = m_serverFd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_serverFd, &ev);
+
+    ev.events = EPOLLIN;
+    ev.data.fd = m_wakeupFd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeupFd, &ev);
+
+    isyslog("starting %i worker threads", m_config.workerThreads);
+    m_workers = new roboTV::ThreadPool(m_config.workerThreads);
+
     Start();
 
     return;
@@ -139,8 +166,23 @@ RoboTVServer::RoboTVServer(int listenPort) : cThread("roboTV VDR Server"), m_con
 RoboTVServer::~RoboTVServer() {
     Cancel(10);
 
-    for(ClientList::iterator i = m_clients.begin(); i != m_clients.end(); i++) {
-        delete(*i);
+    // unblock pending requests and wait for the workers
+    for(auto& i : m_clients) {
+        shutdown(i.first, SHUT_RDWR);
+    }
+
+    delete m_workers;
+
+    for(auto& i : m_clients) {
+        delete i.second.client;
+    }
+
+    if(m_wakeupFd != -1) {
+        close(m_wakeupFd);
+    }
+
+    if(m_epollFd != -1) {
+        close(m_epollFd);
     }
 
     isyslog("roboTV Server stopped");
@@ -208,14 +250,202 @@ void RoboTVServer::clientConnected(int fd) {
         isyslog("Client %s:%i with ID %d connected.", inet_ntoa(((struct sockaddr_in*)&sin)->sin_addr), ((struct sockaddr_in*)&sin)->sin_port, m_idCnt);
     }
 
-    RoboTvClient* connection = new RoboTvClient(fd, m_idCnt);
-    m_clients.push_back(connection);
+    RoboTvClient* connection = new RoboTvClient(this, fd, m_idCnt);
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+
+    if(epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        esyslog("unable to register client %d (errno=%d: %s)", m_idCnt, errno, strerror(errno));
+        delete connection;
+        return;
+    }
+
+    m_clients[fd] = { connection, false, EPOLLIN };
     m_idCnt++;
 }
 
+void RoboTVServer::clientEvent(int fd, uint32_t events) {
+    auto i = m_clients.find(fd);
+
+    if(i == m_clients.end()) {
+        return;
+    }
+
+    ClientState& state = i->second;
+    RoboTvClient* client = state.client;
+
+    if(events & EPOLLOUT) {
+        if(!client->flush()) {
+            client->close();
+        }
+    }
+
+    // read all available data and queue complete requests
+    if((events & EPOLLIN) && !client->closed()) {
+        if(!client->receive()) {
+            client->close();
+        }
+    }
+    else if(events & (EPOLLERR | EPOLLHUP)) {
+        client->close();
+    }
+
+    dispatch(i);
+    updateClient(i);
+}
+
+void RoboTVServer::dispatch(ClientList::iterator i) {
+    ClientState& state = i->second;
+    RoboTvClient* client = state.client;
+    int fd = i->first;
+
+    // only one worker per client keeps the requests in order
+    if(state.busy || client->closed() || (client->pendingRequests() == 0 && !client->pushPending())) {
+        return;
+    }
+
+    state.busy = true;
+
+    m_workers->execute([this, client, fd]() {
+        client->processRequests();
+        notify(fd, Notify::READY);
+    });
+}
+
+void RoboTVServer::updateClient(ClientList::iterator i) {
+    ClientState& state = i->second;
+    RoboTvClient* client = state.client;
+    int fd = i->first;
+
+    if(client->closed()) {
+        // stop polling the socket
+        if(state.events != 0) {
+            epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+            state.events = 0;
+        }
+
+        // the client will be removed as soon as the running request finished
+        if(!state.busy) {
+            isyslog("Client with ID %u seems to be disconnected, removing from client list", client->getId());
+            delete client;
+            m_clients.erase(i);
+        }
+
+        return;
+    }
+
+    // stop reading if the client floods us with requests
+    bool throttle = (client->pendingRequests() >= MAX_PENDING_REQUESTS);
+    uint32_t events = (throttle ? 0 : EPOLLIN) | (client->hasPendingOutput() ? EPOLLOUT : 0);
+
+    if(events == state.events) {
+        return;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+
+    epoll_ctl(m_epollFd, EPOLL_CTL_MOD, fd, &ev);
+    state.events = events;
+}
+
+void RoboTVServer::notify(int fd, Notify what) {
+    bool wakeup = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_notificationLock);
+        wakeup = m_notifications.empty();
+        m_notifications.push_back({fd, what});
+    }
+
+    if(!wakeup) {
+        return;
+    }
+
+    uint64_t value = 1;
+
+    if(write(m_wakeupFd, &value, sizeof(value)) == -1) {
+        esyslog("failed to wakeup server thread (errno=%d: %s)", errno, strerror(errno));
+    }
+}
+
+void RoboTVServer::notifyWrite(int fd) {
+    notify(fd, Notify::WRITE);
+}
+
+void RoboTVServer::notifyPush(int fd) {
+    notify(fd, Notify::PUSH);
+}
+
+void RoboTVServer::processNotifications() {
+    uint64_t value = 0;
+
+    if(read(m_wakeupFd, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+        esyslog("failed to read wakeup event (errno=%d: %s)", errno, strerror(errno));
+    }
+
+    std::deque<Notification> notifications;
+
+    {
+        std::lock_guard<std::mutex> lock(m_notificationLock);
+        notifications.swap(m_notifications);
+    }
+
+    for(auto& n : notifications) {
+        auto i = m_clients.find(n.fd);
+
+        if(i == m_clients.end()) {
+            continue;
+        }
+
+        ClientState& state = i->second;
+
+        if(n.what == Notify::READY) {
+            state.busy = false;
+        }
+
+        if(n.what != Notify::WRITE) {
+            dispatch(i);
+        }
+
+        if(!state.client->closed() && !state.client->flush()) {
+            state.client->close();
+        }
+
+        updateClient(i);
+    }
+}
+
+void RoboTVServer::removeDisconnectedClients() {
+    for(auto i = m_clients.begin(); i != m_clients.end();) {
+        auto current = i++;
+
+        if(current->second.client->closed()) {
+            updateClient(current);
+        }
+    }
+}
+
 void RoboTVServer::broadcastMessage(MsgPacket* p) {
+    StatusPacket packet;
+    packet[0].reset(p);
+
+    broadcastMessage(packet);
+}
+
+void RoboTVServer::broadcastMessage(const StatusPacket& packet) {
+    // packets are shared between clients from now on
+    for(auto& i : packet) {
+        i.second->freeze();
+    }
+
     std::lock_guard<std::mutex> lock(m_broadcastLock);
-    m_broadcast.push_back(p);
+    m_broadcast.push_back(packet);
 }
 
 void RoboTVServer::UpdateRecordings() {
@@ -231,12 +461,13 @@ void RoboTVServer::UpdateTimers() {
 }
 
 void RoboTVServer::Action(void) {
-    fd_set fds;
-    struct timeval tv;
+    static const int maxEvents = 32;
+    struct epoll_event events[maxEvents];
 
     // artwork
     Artwork artwork;
     cTimeMs cleanupTimer;
+    cTimeMs housekeepingTimer;
 
     isyslog("creating SDP client");
     roboTV::Sdp& sdp = roboTV::Sdp::createInstance();
@@ -257,80 +488,103 @@ void RoboTVServer::Action(void) {
     isyslog("roboTV Server started");
 
     while(Running()) {
-        // poll sdp
-        sdp.poll();
+        int r = epoll_wait(m_epollFd, events, maxEvents, 250);
 
-        // poll network socket
-        FD_ZERO(&fds);
-        FD_SET(m_serverFd, &fds);
+        if(r == -1 && errno != EINTR) {
+            esyslog("failed during epoll_wait");
+            continue;
+        }
 
-        tv.tv_sec = 0;
-        tv.tv_usec = 250 * 1000;
+        for(int n = 0; n < r; n++) {
+            int fd = events[n].data.fd;
+
+            // wakeup from worker threads
+            if(fd == m_wakeupFd) {
+                processNotifications();
+                continue;
+            }
+
+            // client socket event
+            if(fd != m_serverFd) {
+                clientEvent(fd, events[n].events);
+                continue;
+            }
 
-        int r = select(m_serverFd + 1, &fds, NULL, NULL, &tv);
+            // connect request
+            int clientFd = accept(m_serverFd, 0, 0);
 
-        if(r == -1) {
-            esyslog("failed during select");
+            if(clientFd >= 0) {
+                clientConnected(clientFd);
+            }
+            else {
+                esyslog("accept failed");
+            }
+        }
+
+        if(housekeepingTimer.Elapsed() < 250) {
             continue;
         }
 
-        if(r == 0) {
-            // remove disconnected clients
-            for(ClientList::iterator i = m_clients.begin(); i != m_clients.end();) {
+        housekeepingTimer.Set(0);
 
-                if(!(*i)->Active()) {
-                    isyslog("Client with ID %u seems to be disconnected, removing from client list", (*i)->getId());
-                    delete(*i);
-                    i = m_clients.erase(i);
-                }
-                else {
-                    i++;
-                }
+        // poll sdp
+        sdp.poll();
+
+        // remove disconnected clients
+        removeDisconnectedClients();
+
+        // let waiting stream requests time out
+        for(auto& i : m_clients) {
+            RoboTvClient* client = i.second.client;
+
+            if(!client->closed() && client->streamRequestPending()) {
+                client->requestPush();
             }
+        }
+
+        // send pending broadcast messages
+        {
+            std::lock_guard<std::mutex> lock(m_broadcastLock);
 
-            // send pending broadcast messages
-            {
-                std::lock_guard<std::mutex> lock(m_broadcastLock);
+            while(!m_broadcast.empty()) {
+                StatusPacket& packet = m_broadcast.front();
 
-                while(!m_broadcast.empty()) {
-                    MsgPacket* p = m_broadcast.front();
+                for(auto& i: m_clients) {
+                    RoboTvClient* client = i.second.client;
 
-                    for(auto& client: m_clients) {
-                        client->broadcastMessage(p);
+                    if(client->closed() || !client->statusEnabled()) {
+                        continue;
                     }
 
-                    m_broadcast.pop_front();
-                    delete p;
-                }
-            }
+                    auto p = packet.find(client->protocolVersion());
 
-            // cleanup (every hour)
-            if(cleanupTimer.Elapsed() >= 60 * 60 * 1000) {
-                isyslog("removing outdated artwork");
-                artwork.triggerCleanup();
-                // start gc
-                isyslog("Starting garbage collection in recordings cache");
-                cache.triggerCleanup();
+                    if(p == packet.end()) {
+                        p = packet.find(0);
+                    }
 
-                cleanupTimer.Set(0);
-            }
+                    if(p != packet.end()) {
+                        client->broadcastMessage(p->second);
+                    }
+                }
 
-            // reset inactivity timeout as long as there are clients connected
-            if(m_clients.size() > 0) {
-                ShutdownHandler.SetUserInactiveTimeout();
+                m_broadcast.pop_front();
             }
-
-            // no connect request -> continue waiting
-            continue;
         }
 
-        int fd = accept(m_serverFd, 0, 0);
+        // cleanup (every hour)
+        if(cleanupTimer.Elapsed() >= 60 * 60 * 1000) {
+            isyslog("removing outdated artwork");
+            artwork.triggerCleanup();
+            // start gc
+            isyslog("Starting garbage collection in recordings cache");
+            cache.triggerCleanup();
 
-        if(fd >= 0) {
-            clientConnected(fd);
+            cleanupTimer.Set(0);
         }
-        else {
-            esyslog("accept failed");
+
+        // reset inactivity timeout as long as there are clients connected
+        if(m_clients.size() > 0) {
+            ShutdownHandler.SetUserInactiveTimeout();
         }
     }
 
@@ -25,12 +25,15 @@
 #ifndef ROBOTV_SERVER_H
 #define ROBOTV_SERVER_H
 
-#include <list>
+#include <map>
 #include <deque>
 #include <mutex>
+#include <memory>
 #include <vdr/thread.h>
 
 #include "config/config.h"
+#include "tools/threadpool.h"
+#include "robotvstatus.h"
 
 class RoboTvClient;
 class MsgPacket;
@@ -38,40 +41,116 @@ class MsgPacket;
 class RoboTVServer : public cThread {
 protected:
 
-    typedef std::list<RoboTvClient*> ClientList;
+    struct ClientState {
+        RoboTvClient* client;
+        bool busy;
+        uint32_t events;
+    };
+
+    enum class Notify {
+        WRITE,
+        READY,
+        PUSH
+    };
+
+    struct Notification {
+        int fd;
+        Notify what;
+    };
+
+    typedef std::map<int, ClientState> ClientList;
 
     virtual void Action(void);
 
     void clientConnected(int fd);
 
+    void clientEvent(int fd, uint32_t events);
+
+    void updateClient(ClientList::iterator i);
+
+    void dispatch(ClientList::iterator i);
+
+    void processNotifications();
+
+    void notify(int fd, Notify what);
+
+    void removeDisconnectedClients();
+
     int m_serverPort;
 
     int m_serverFd;
 
+    int m_epollFd;
+
+    int m_wakeupFd;
+
     bool m_ipv4Fallback;
 
     cString m_allowedHostsFile;
 
     ClientList m_clients;
 
+    roboTV::ThreadPool* m_workers;
+
+    std::deque<Notification> m_notifications;
+
+    std::mutex m_notificationLock;
+
     RoboTVServerConfig& m_config;
 
     static unsigned int m_idCnt;
 
-    static std::deque<MsgPacket*> m_broadcast;
+    RoboTvStatus m_status;
 
 private:
 
-    static void broadcastMessage(MsgPacket* p);
-
     static std::mutex m_broadcastLock;
 
+public:
+
+    /**
+     * Shared status packet.
+     * Maps the protocol version to the packet. Version 0 denotes a packet
+     * that is valid for all protocol versions.
+     */
+    typedef std::map<uint16_t, std::shared_ptr<MsgPacket>> StatusPacket;
+
+private:
+
+    static std::deque<StatusPacket> m_broadcast;
+
 public:
 
     RoboTVServer(int listenPort);
 
     virtual ~RoboTVServer();
 
+    /**
+     * Request a flush of the clients message queue.
+     * May be called from any thread.
+     * @param fd socket of the client
+     */
+    void notifyWrite(int fd);
+
+    /**
+     * Request a worker to push new stream packets to the client.
+     * May be called from any thread.
+     * @param fd socket of the client
+     */
+    void notifyPush(int fd);
+
+    /**
+     * Broadcast a status packet to all clients.
+     * @param p packet valid for all protocol versions (ownership is transferred)
+     */
+    static void broadcastMessage(MsgPacket* p);
+
+    /**
+     * Broadcast a status packet to all clients.
+     * @param packet packet variants for each protocol version
+     */
+    static void broadcastMessage(const StatusPacket& packet);
+
     static void UpdateRecordings();
 
     static void UpdateTimers();
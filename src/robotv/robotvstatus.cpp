@@ -0,0 +1,138 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <thread>
+
+#include <vdr/recording.h>
+#include <vdr/timers.h>
+
+#include "robotvcommand.h"
+#include "robotvserver.h"
+#include "robotvstatus.h"
+#include "controllers/timercontroller.h"
+#include "tools/utf8conv.h"
+
+RoboTvStatus::RoboTvStatus() {
+}
+
+RoboTvStatus::~RoboTvStatus() {
+}
+
+void RoboTvStatus::Recording(const cDevice* Device, const char* Name, const char* FileName, bool On) {
+    std::string fileName = (FileName == nullptr) ? "": FileName;
+    std::string name = (Name == nullptr) ? "" : Name;
+
+    isyslog("----------------------------------");
+    isyslog("RECORDINGEVENT:");
+    isyslog("Filename:  %s", fileName.c_str());
+    isyslog("Name:      %s", name.c_str());
+    isyslog("Recording: %s", On ? "Yes" : "No");
+    isyslog("----------------------------------");
+
+    // execute in thread to prevent invalid locking
+    std::thread t([this, fileName, On]() {
+        LOCK_RECORDINGS_READ;
+
+        auto r = Recordings->GetByName(fileName.c_str());
+
+        if(r != nullptr) {
+            const cRecordingInfo* info = r->Info();
+
+            if(info != nullptr) {
+                const cEvent* e = info->GetEvent();
+                onRecording(e, On);
+            }
+        }
+
+        // also request timers update on recording change (the status of the
+        // timer changes)
+
+        RoboTVServer::UpdateTimers();
+    });
+    t.join();
+}
+
+void RoboTvStatus::TimerChange(const cTimer* Timer, eTimerChange Change) {
+    // ignore invalid timers
+    if(Timer == NULL) {
+        return;
+    }
+
+    isyslog("Sending timer change request to clients ...");
+    RoboTVServer::StatusPacket packet;
+
+    // the timer data depends on the protocol version
+    for(uint16_t version = ROBOTV_PROTOCOLVERSION_MIN; version <= ROBOTV_PROTOCOLVERSION; version++) {
+        MsgPacket* resp = new MsgPacket(ROBOTV_STATUS_TIMERCHANGE, ROBOTV_CHANNEL_STATUS);
+        resp->setProtocolVersion(version);
+
+        if(Change == tcAdd) {
+            TimerController::timer2Packet(Timer, resp);
+        }
+
+        packet[version].reset(resp);
+    }
+
+    RoboTVServer::broadcastMessage(packet);
+}
+
+void RoboTvStatus::ChannelChange(const cChannel* Channel) {
+    MsgPacket* resp = new MsgPacket(ROBOTV_STATUS_CHANNELCHANGED, ROBOTV_CHANNEL_STATUS);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_channelController.addChannelToPacket(Channel, resp);
+    }
+
+    RoboTVServer::broadcastMessage(resp);
+}
+
+void RoboTvStatus::onRecording(const cEvent* event, bool on) {
+    if(event == nullptr) {
+        return;
+    }
+
+    Utf8Conv toUtf8;
+    RoboTVServer::StatusPacket packet;
+
+    const char* title = event->Title();
+    const char* desc = event->Description();
+
+    // the event data depends on the protocol version
+    for(uint16_t version = ROBOTV_PROTOCOLVERSION_MIN; version <= ROBOTV_PROTOCOLVERSION; version++) {
+        MsgPacket* resp = new MsgPacket(ROBOTV_STATUS_RECORDING, ROBOTV_CHANNEL_STATUS);
+        resp->setProtocolVersion(version);
+
+        resp->put_U32((uint32_t)event->Index());
+        resp->put_U32(on ? 1 : 0);
+        resp->put_String(toUtf8.convert(title != nullptr ? title : ""));
+        resp->put_String(toUtf8.convert(desc != nullptr ? desc : ""));
+
+        TimerController::event2Packet(event, resp);
+        packet[version].reset(resp);
+    }
+
+    RoboTVServer::broadcastMessage(packet);
+}
@@ -0,0 +1,65 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_STATUS_H
+#define ROBOTV_STATUS_H
+
+#include <mutex>
+#include <vdr/status.h>
+
+#include "controllers/channelcontroller.h"
+
+class cEvent;
+
+/**
+ * Server wide status monitor.
+ * Creates the status packets for VDR events once and broadcasts them to
+ * all clients with an enabled status interface.
+ */
+class RoboTvStatus : public cStatus {
+public:
+
+    RoboTvStatus();
+
+    virtual ~RoboTvStatus();
+
+protected:
+
+    virtual void Recording(const cDevice* Device, const char* Name, const char* FileName, bool On);
+
+    virtual void TimerChange(const cTimer* Timer, eTimerChange Change);
+
+    virtual void ChannelChange(const cChannel* Channel);
+
+private:
+
+    void onRecording(const cEvent* event, bool on);
+
+    ChannelController m_channelController;
+
+    std::mutex m_mutex;
+};
+
+#endif // ROBOTV_STATUS_H
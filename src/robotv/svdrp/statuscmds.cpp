@@ -0,0 +1,69 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <strings.h>
+
+#include "statuscmds.h"
+#include "tools/statistics.h"
+#include "live/timeshiftmanager.h"
+#include "live/timeshiftwriter.h"
+
+StatusCmds::StatusCmds() {
+}
+
+StatusCmds::StatusCmds(const StatusCmds& orig) {
+}
+
+StatusCmds::~StatusCmds() {
+}
+
+cString StatusCmds::SVDRPCommand(const char* Command, const char* Option, int& ReplyCode) {
+    if(strcasecmp(Command, "STAT") == 0) {
+        return processStatistics(Option, ReplyCode);
+    }
+
+    if(strcasecmp(Command, "TSHF") == 0) {
+        return processTimeShift(Option, ReplyCode);
+    }
+
+    if(strcasecmp(Command, "TSWR") == 0) {
+        return processTimeShiftWriter(Option, ReplyCode);
+    }
+
+    ReplyCode = 500;
+    return NULL;
+}
+
+cString StatusCmds::processStatistics(const char* Option, int& ReplyCode) {
+    return cString(roboTV::Statistics::instance().dump().c_str());
+}
+
+cString StatusCmds::processTimeShift(const char* Option, int& ReplyCode) {
+    return cString(TimeShiftManager::instance().report().c_str());
+}
+
+cString StatusCmds::processTimeShiftWriter(const char* Option, int& ReplyCode) {
+    return cString(TimeShiftWriter::instance().report().c_str());
+}
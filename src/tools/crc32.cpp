@@ -0,0 +1,357 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <string.h>
+
+#include "crc32.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CRC32_PCLMUL
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) || (defined(__arm__) && defined(__ARM_FEATURE_CRC32))
+#define CRC32_ARMV8
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace roboTV {
+
+namespace {
+
+typedef uint32_t (*Function)(uint32_t crc, const uint8_t* buf, size_t size);
+
+/**
+ * Lookup tables for slice-by-16.
+ * table[0] is the classic byte-at-a-time table.
+ */
+struct Tables {
+    uint32_t table[16][256];
+
+    Tables() {
+        for(uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+
+            for(int j = 0; j < 8; j++) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : (crc >> 1);
+            }
+
+            table[0][i] = crc;
+        }
+
+        for(uint32_t i = 0; i < 256; i++) {
+            for(int k = 1; k < 16; k++) {
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+const Tables& tables() {
+    static Tables t;
+    return t;
+}
+
+uint32_t crcTable(uint32_t crc, const uint8_t* buf, size_t size) {
+    const uint32_t* t = tables().table[0];
+
+    while(size--) {
+        crc = t[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+uint32_t crcSliceBy16(uint32_t crc, const uint8_t* buf, size_t size) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    const uint32_t (*t)[256] = tables().table;
+
+    while(size >= 16) {
+        uint32_t w[4];
+        memcpy(w, buf, sizeof(w));
+        w[0] ^= crc;
+
+        crc = t[15][w[0] & 0xFF] ^ t[14][(w[0] >> 8) & 0xFF] ^ t[13][(w[0] >> 16) & 0xFF] ^ t[12][w[0] >> 24] ^
+              t[11][w[1] & 0xFF] ^ t[10][(w[1] >> 8) & 0xFF] ^ t[9][(w[1] >> 16) & 0xFF] ^ t[8][w[1] >> 24] ^
+              t[7][w[2] & 0xFF] ^ t[6][(w[2] >> 8) & 0xFF] ^ t[5][(w[2] >> 16) & 0xFF] ^ t[4][w[2] >> 24] ^
+              t[3][w[3] & 0xFF] ^ t[2][(w[3] >> 8) & 0xFF] ^ t[1][(w[3] >> 16) & 0xFF] ^ t[0][w[3] >> 24];
+
+        buf += 16;
+        size -= 16;
+    }
+#endif
+
+    return crcTable(crc, buf, size);
+}
+
+#ifdef CRC32_PCLMUL
+
+// folding constants for the reflected polynomial 0x04C11DB7
+// (see "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel)
+alignas(16) const uint64_t k1k2[2] = { 0x0154442bd4, 0x01c6e41596 };
+alignas(16) const uint64_t k3k4[2] = { 0x01751997d0, 0x00ccaa009e };
+alignas(16) const uint64_t k5k0[2] = { 0x0163cd6124, 0x0000000000 };
+alignas(16) const uint64_t poly[2] = { 0x01db710641, 0x01f7011641 };
+
+__attribute__((target("pclmul,sse4.1")))
+uint32_t crcPclmul(uint32_t crc, const uint8_t* buf, size_t size) {
+    if(size < 64) {
+        return crcSliceBy16(crc, buf, size);
+    }
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+    __m128i y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    x0 = _mm_load_si128((const __m128i*)k1k2);
+
+    buf += 64;
+    size -= 64;
+
+    // fold 512 bits per iteration
+    while(size >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        buf += 64;
+        size -= 64;
+    }
+
+    // fold into 128 bits
+    x0 = _mm_load_si128((const __m128i*)k3k4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // single fold blocks of 128 bits
+    while(size >= 16) {
+        x2 = _mm_loadu_si128((const __m128i*)buf);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        buf += 16;
+        size -= 16;
+    }
+
+    // fold 128 bits to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // barrett reduction to 32 bits
+    x0 = _mm_load_si128((const __m128i*)poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    crc = (uint32_t)_mm_extract_epi32(x1, 1);
+
+    // remaining bytes
+    return crcSliceBy16(crc, buf, size);
+}
+
+#endif // CRC32_PCLMUL
+
+#ifdef CRC32_ARMV8
+
+#ifdef __aarch64__
+__attribute__((target("+crc")))
+#endif
+uint32_t crcArmv8(uint32_t crc, const uint8_t* buf, size_t size) {
+    while(size >= 8) {
+        uint64_t v;
+        memcpy(&v, buf, sizeof(v));
+        crc = __crc32d(crc, v);
+
+        buf += 8;
+        size -= 8;
+    }
+
+    if(size >= 4) {
+        uint32_t v;
+        memcpy(&v, buf, sizeof(v));
+        crc = __crc32w(crc, v);
+
+        buf += 4;
+        size -= 4;
+    }
+
+    while(size--) {
+        crc = __crc32b(crc, *buf++);
+    }
+
+    return crc;
+}
+
+#endif // CRC32_ARMV8
+
+Function select(Crc32::Engine engine) {
+    switch(engine) {
+#ifdef CRC32_PCLMUL
+        case Crc32::Engine::Pclmul:
+            return crcPclmul;
+#endif
+#ifdef CRC32_ARMV8
+        case Crc32::Engine::Armv8:
+            return crcArmv8;
+#endif
+        case Crc32::Engine::SliceBy16:
+            return crcSliceBy16;
+
+        default:
+            return crcTable;
+    }
+}
+
+Crc32::Engine detect() {
+#ifdef CRC32_PCLMUL
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+        return Crc32::Engine::Pclmul;
+    }
+#endif
+
+#if defined(CRC32_ARMV8) && defined(__aarch64__)
+    if(getauxval(AT_HWCAP) & HWCAP_CRC32) {
+        return Crc32::Engine::Armv8;
+    }
+#elif defined(CRC32_ARMV8)
+    if(getauxval(AT_HWCAP2) & HWCAP2_CRC32) {
+        return Crc32::Engine::Armv8;
+    }
+#endif
+
+    return Crc32::Engine::SliceBy16;
+}
+
+struct Dispatch {
+    Crc32::Engine engine;
+    Function compute;
+
+    Dispatch() : engine(detect()), compute(select(engine)) {
+        tables();
+    }
+};
+
+const Dispatch& dispatch() {
+    static Dispatch d;
+    return d;
+}
+
+}
+
+uint32_t Crc32::checksum(const uint8_t* buf, size_t size) {
+    return dispatch().compute(0xFFFFFFFF, buf, size) ^ 0xFFFFFFFF;
+}
+
+uint32_t Crc32::update(uint32_t crc, const uint8_t* buf, size_t size) {
+    return dispatch().compute(crc ^ 0xFFFFFFFF, buf, size) ^ 0xFFFFFFFF;
+}
+
+uint32_t Crc32::checksum(Engine engine, const uint8_t* buf, size_t size) {
+    return select(engine)(0xFFFFFFFF, buf, size) ^ 0xFFFFFFFF;
+}
+
+bool Crc32::supported(Engine engine) {
+    switch(engine) {
+        case Engine::Table:
+        case Engine::SliceBy16:
+            return true;
+
+        default:
+            return (engine == dispatch().engine);
+    }
+}
+
+Crc32::Engine Crc32::engine() {
+    return dispatch().engine;
+}
+
+const char* Crc32::name(Engine engine) {
+    switch(engine) {
+        case Engine::Table:
+            return "table";
+
+        case Engine::SliceBy16:
+            return "slice-by-16";
+
+        case Engine::Pclmul:
+            return "pclmul";
+
+        case Engine::Armv8:
+            return "armv8";
+    }
+
+    return "unknown";
+}
+
+} // namespace roboTV
@@ -0,0 +1,86 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_CRC32_H
+#define ROBOTV_CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace roboTV {
+
+/**
+ * CRC32 (IEEE 802.3, zlib compatible) checksum.
+ * The fastest implementation available on the CPU is selected at runtime.
+ */
+class Crc32 {
+public:
+
+    enum class Engine {
+        Table,          /*!< byte-at-a-time table lookup (reference) */
+        SliceBy16,      /*!< portable slice-by-16 */
+        Pclmul,         /*!< x86 carry-less multiplication folding */
+        Armv8           /*!< ARMv8 CRC32 instructions */
+    };
+
+    /**
+     * Compute the checksum of a buffer.
+     * @param buf pointer to data
+     * @param size size of data in bytes
+     * @return crc32 checksum
+     */
+    static uint32_t checksum(const uint8_t* buf, size_t size);
+
+    /**
+     * Continue a checksum.
+     * @param crc checksum of the preceding data (0 for the first block)
+     * @param buf pointer to data
+     * @param size size of data in bytes
+     * @return crc32 checksum
+     */
+    static uint32_t update(uint32_t crc, const uint8_t* buf, size_t size);
+
+    /**
+     * Compute the checksum with a specific engine.
+     * The engine must be supported by the CPU.
+     */
+    static uint32_t checksum(Engine engine, const uint8_t* buf, size_t size);
+
+    /**
+     * Check if the engine is supported by the CPU.
+     */
+    static bool supported(Engine engine);
+
+    /**
+     * Get the engine selected at runtime.
+     */
+    static Engine engine();
+
+    static const char* name(Engine engine);
+};
+
+} // namespace roboTV
+
+#endif // ROBOTV_CRC32_H
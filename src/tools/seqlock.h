@@ -0,0 +1,113 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_SEQLOCK_H
+#define ROBOTV_SEQLOCK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+namespace roboTV {
+
+/**
+ * Sequence lock for a small value with exactly one writer thread.
+ * Readers never block the writer. A reader retries if the value has been
+ * modified while it was copied. The value is stored in atomic words, so
+ * concurrent copies are well defined.
+ */
+template<class T>
+class SeqLock {
+public:
+
+    SeqLock() : m_sequence(0) {
+        static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable type");
+        store(T());
+    }
+
+    /**
+     * Publish a new value (writer side).
+     * @param value new value
+     */
+    void store(const T& value) {
+        uint64_t words[WORDS] = {};
+        memcpy(words, &value, sizeof(T));
+
+        uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for(size_t i = 0; i < WORDS; i++) {
+            m_data[i].store(words[i], std::memory_order_relaxed);
+        }
+
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /**
+     * Get a consistent copy of the value (reader side).
+     * @return the current value
+     */
+    T load() const {
+        uint64_t words[WORDS];
+        uint64_t sequence;
+
+        for(;;) {
+            sequence = m_sequence.load(std::memory_order_acquire);
+
+            // update in progress
+            if(sequence & 1) {
+                continue;
+            }
+
+            for(size_t i = 0; i < WORDS; i++) {
+                words[i] = m_data[i].load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if(m_sequence.load(std::memory_order_relaxed) == sequence) {
+                break;
+            }
+        }
+
+        T value;
+        memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+private:
+
+    static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint64_t> m_sequence;
+
+    std::atomic<uint64_t> m_data[WORDS];
+};
+
+} // namespace roboTV
+
+#endif // ROBOTV_SEQLOCK_H
@@ -0,0 +1,116 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_SPSCRING_H
+#define ROBOTV_SPSCRING_H
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+namespace roboTV {
+
+/**
+ * Bounded lock-free ring for exactly one producer and one consumer thread.
+ * The capacity is rounded up to the next power of two.
+ */
+template<class T>
+class SpscRing {
+public:
+
+    SpscRing(size_t capacity) : m_head(0), m_tail(0) {
+        size_t size = 1;
+
+        while(size < capacity) {
+            size <<= 1;
+        }
+
+        m_items.resize(size);
+        m_mask = size - 1;
+    }
+
+    /**
+     * Append an item (producer side).
+     * @param item item to append
+     * @return false if the ring is full
+     */
+    bool push(const T& item) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+
+        if(head - m_tail.load(std::memory_order_acquire) > m_mask) {
+            return false;
+        }
+
+        m_items[head & m_mask] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Remove the oldest item (consumer side).
+     * @param item receives the removed item
+     * @return false if the ring is empty
+     */
+    bool pop(T& item) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+
+        if(tail == m_head.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        item = m_items[tail & m_mask];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    size_t capacity() const {
+        return m_mask + 1;
+    }
+
+private:
+
+    std::vector<T> m_items;
+
+    size_t m_mask;
+
+    // keep producer and consumer index on separate cache lines
+    std::atomic<size_t> m_head;
+
+    char m_padding[64 - sizeof(std::atomic<size_t>)];
+
+    std::atomic<size_t> m_tail;
+};
+
+} // namespace roboTV
+
+#endif // ROBOTV_SPSCRING_H
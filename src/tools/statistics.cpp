@@ -0,0 +1,94 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include "statistics.h"
+#include "json.hpp"
+
+namespace roboTV {
+
+Statistics::Statistics() : m_lastDump(Clock::now()) {
+}
+
+Statistics& Statistics::instance() {
+    static Statistics statistics;
+    return statistics;
+}
+
+Statistics::Counter& Statistics::counter(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto i = m_counters.find(name);
+
+    if(i != m_counters.end()) {
+        return *i->second.value;
+    }
+
+    Entry& entry = m_counters[name];
+    entry.value.reset(new Counter(0));
+    entry.last = 0;
+
+    return *entry.value;
+}
+
+Statistics::Maximum& Statistics::maximum(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& entry = m_maxima[name];
+
+    if(!entry) {
+        entry.reset(new Maximum());
+    }
+
+    return *entry;
+}
+
+std::string Statistics::dump() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    nlohmann::json result = nlohmann::json::object();
+
+    Clock::time_point now = Clock::now();
+    double seconds = std::chrono::duration<double>(now - m_lastDump).count();
+    m_lastDump = now;
+
+    for(auto& i : m_counters) {
+        Entry& entry = i.second;
+        uint64_t value = entry.value->load();
+
+        result[i.first] = {
+            { "total", value },
+            { "rate", (seconds > 0 && value >= entry.last) ? (double)(value - entry.last) / seconds : 0.0 }
+        };
+
+        entry.last = value;
+    }
+
+    for(auto& i : m_maxima) {
+        result[i.first] = {
+            { "max", i.second->value() }
+        };
+    }
+
+    return result.dump();
+}
+
+} // namespace roboTV
@@ -0,0 +1,122 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef ROBOTV_STATISTICS_H
+#define ROBOTV_STATISTICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace roboTV {
+
+/**
+ * Registry of named runtime counters.
+ * Counters are created on first use and live as long as the plugin.
+ * The values can be queried via the SVDRP "STAT" command.
+ */
+class Statistics {
+public:
+
+    typedef std::atomic<uint64_t> Counter;
+
+    /**
+     * High-water mark.
+     * Keeps the largest value reported from any thread.
+     */
+    class Maximum {
+    public:
+
+        Maximum() : m_value(0) {
+        }
+
+        void update(uint64_t value) {
+            uint64_t current = m_value.load(std::memory_order_relaxed);
+
+            while(value > current && !m_value.compare_exchange_weak(current, value, std::memory_order_relaxed));
+        }
+
+        uint64_t value() const {
+            return m_value.load(std::memory_order_relaxed);
+        }
+
+    private:
+
+        std::atomic<uint64_t> m_value;
+    };
+
+    static Statistics& instance();
+
+    /**
+     * Get a counter.
+     * The returned reference stays valid, so it can be kept in a static variable.
+     * @param name name of the counter
+     * @return reference to the counter
+     */
+    Counter& counter(const std::string& name);
+
+    /**
+     * Get a high-water mark.
+     * The returned reference stays valid, so it can be kept in a static variable.
+     * @param name name of the high-water mark
+     * @return reference to the high-water mark
+     */
+    Maximum& maximum(const std::string& name);
+
+    /**
+     * Dump all counters.
+     * Each counter is reported with its total and the rate per second
+     * since the previous dump, each high-water mark with its maximum.
+     * @return counters in JSON format
+     */
+    std::string dump();
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    Statistics();
+
+    struct Entry {
+        std::unique_ptr<Counter> value;
+        uint64_t last;
+    };
+
+    std::map<std::string, Entry> m_counters;
+
+    std::map<std::string, std::unique_ptr<Maximum>> m_maxima;
+
+    std::mutex m_mutex;
+
+    Clock::time_point m_lastDump;
+};
+
+} // namespace roboTV
+
+#endif // ROBOTV_STATISTICS_H
@@ -0,0 +1,97 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include "threadpool.h"
+
+namespace roboTV {
+
+ThreadPool::ThreadPool(int threads) : m_running(true) {
+    if(threads < 1) {
+        threads = 1;
+    }
+
+    for(int i = 0; i < threads; i++) {
+        m_threads.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    shutdown();
+}
+
+void ThreadPool::execute(const Job& job) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if(!m_running) {
+            return;
+        }
+
+        m_jobs.push_back(job);
+    }
+
+    m_cond.notify_one();
+}
+
+void ThreadPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+        m_jobs.clear();
+    }
+
+    m_cond.notify_all();
+
+    for(auto& t : m_threads) {
+        if(t.joinable()) {
+            t.join();
+        }
+    }
+
+    m_threads.clear();
+}
+
+void ThreadPool::run() {
+    while(true) {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this]() {
+                return !m_running || !m_jobs.empty();
+            });
+
+            if(!m_running) {
+                return;
+            }
+
+            job = m_jobs.front();
+            m_jobs.pop_front();
+        }
+
+        job();
+    }
+}
+
+} // namespace roboTV
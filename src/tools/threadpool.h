@@ -0,0 +1,83 @@
+/*
+ *      vdr-plugin-robotv - roboTV server plugin for VDR
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef ROBOTV_THREADPOOL_H
+#define ROBOTV_THREADPOOL_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace roboTV {
+
+/**
+ * Fixed size pool of worker threads.
+ * Jobs are executed in FIFO order by the next idle worker.
+ */
+class ThreadPool {
+public:
+
+    typedef std::function<void()> Job;
+
+    ThreadPool(int threads);
+
+    virtual ~ThreadPool();
+
+    /**
+     * Queue a job for execution.
+     * @param job function to execute on one of the worker threads
+     */
+    void execute(const Job& job);
+
+    /**
+     * Stop all workers.
+     * Pending jobs are discarded, running jobs will be finished.
+     */
+    void shutdown();
+
+    int size() const {
+        return (int)m_threads.size();
+    }
+
+private:
+
+    void run();
+
+    std::vector<std::thread> m_threads;
+
+    std::deque<Job> m_jobs;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_cond;
+
+    bool m_running;
+};
+
+} // namespace roboTV
+
+#endif // ROBOTV_THREADPOOL_H
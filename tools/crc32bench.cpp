@@ -0,0 +1,104 @@
+/*
+ *      RoboTV CRC32 Benchmark
+ *
+ *      Copyright (C) 2017 Alexander Pipelka
+ *
+ *      https://github.com/pipelka/vdr-plugin-robotv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <vector>
+
+#include "tools/crc32.h"
+
+using namespace roboTV;
+
+static double benchmark(Crc32::Engine engine, const std::vector<uint8_t>& buffer, size_t blockSize, uint32_t& crc) {
+    size_t total = 256 * 1024 * 1024;
+    size_t count = total / blockSize;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(size_t i = 0; i < count; i++) {
+        size_t offset = (i * blockSize) % (buffer.size() - blockSize + 1);
+        crc ^= Crc32::checksum(engine, buffer.data() + offset, blockSize);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return (double)(count * blockSize) / (1024.0 * 1024.0) / elapsed.count();
+}
+
+int main() {
+    std::vector<uint8_t> buffer(4 * 1024 * 1024);
+    srand(1);
+
+    for(auto& b : buffer) {
+        b = (uint8_t)rand();
+    }
+
+    const Crc32::Engine engines[] = {
+        Crc32::Engine::Table,
+        Crc32::Engine::SliceBy16,
+        Crc32::Engine::Pclmul,
+        Crc32::Engine::Armv8
+    };
+
+    const size_t blockSizes[] = { 32, 512, 4096, 128 * 1024, 2 * 1024 * 1024 };
+
+    printf("selected engine: %s\n\n", Crc32::name(Crc32::engine()));
+    printf("%-12s", "engine");
+
+    for(auto size : blockSizes) {
+        printf(" %10zu B", size);
+    }
+
+    printf("   (MB/s)\n");
+    int rc = 0;
+
+    for(auto engine : engines) {
+        if(!Crc32::supported(engine)) {
+            continue;
+        }
+
+        // verify results against the reference implementation
+        for(size_t length = 0; length < 1024; length++) {
+            if(Crc32::checksum(engine, buffer.data() + 1, length) != Crc32::checksum(Crc32::Engine::Table, buffer.data() + 1, length)) {
+                printf("%s: checksum mismatch at length %zu\n", Crc32::name(engine), length);
+                rc = 1;
+                break;
+            }
+        }
+
+        printf("%-12s", Crc32::name(engine));
+        uint32_t crc = 0;
+
+        for(auto size : blockSizes) {
+            printf(" %12.1f", benchmark(engine, buffer, size, crc));
+            fflush(stdout);
+        }
+
+        printf("   [%08x]\n", crc);
+    }
+
+    return rc;
+}